@@ -0,0 +1,755 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include "asyncfile.h"
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <io.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined( __linux__ ) && defined( __has_include )
+#if __has_include( <linux/io_uring.h> )
+#define FILEDEEN_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+#endif
+#endif
+using namespace FileDeen;
+
+#ifdef _WIN32
+static const AsyncFileHandle invalidFile = INVALID_HANDLE_VALUE;
+#else
+static const AsyncFileHandle invalidFile = -1;
+#endif
+
+static AsyncFileHandle openFile( const std::filesystem::path& fileName, bool write, bool truncate, bool direct = false ) {
+#ifdef _WIN32
+	DWORD creation = !write ? OPEN_EXISTING : (truncate ? CREATE_ALWAYS : OPEN_ALWAYS);
+	DWORD attributes = !write ? FILE_FLAG_SEQUENTIAL_SCAN : (direct ? FILE_FLAG_NO_BUFFERING : FILE_ATTRIBUTE_NORMAL);
+	return CreateFileW( fileName.wstring().c_str(), write ? GENERIC_WRITE : GENERIC_READ, FILE_SHARE_READ, nullptr, creation, attributes, nullptr );
+#else
+	int flags = write ? O_WRONLY | O_CREAT | (truncate ? O_TRUNC : 0) : O_RDONLY;
+#ifdef O_DIRECT
+	if ( direct ) {
+		flags |= O_DIRECT;
+	}
+#else
+	if ( direct ) {
+		return invalidFile;
+	}
+#endif
+	return ::open( fileName.c_str(), flags | O_CLOEXEC, 0666 );
+#endif
+}
+
+static void closeFile( AsyncFileHandle file ) {
+#ifdef _WIN32
+	CloseHandle( file );
+#else
+	::close( file );
+#endif
+}
+
+static bool setFileLength( AsyncFileHandle file, uint64_t length ) {
+#ifdef _WIN32
+	FILE_END_OF_FILE_INFO endOfFile;
+	endOfFile.EndOfFile.QuadPart = (LONGLONG)length;
+	return SetFileInformationByHandle( file, FileEndOfFileInfo, &endOfFile, sizeof( endOfFile ) ) != 0;
+#else
+	return ftruncate( file, (off_t)length ) == 0;
+#endif
+}
+
+static bool fileSize( AsyncFileHandle file, uint64_t& size ) {
+#ifdef _WIN32
+	LARGE_INTEGER fileSize;
+	if ( !GetFileSizeEx( file, &fileSize ) ) {
+		return false;
+	}
+	size = fileSize.QuadPart;
+#else
+	struct stat fileStat;
+	if ( fstat( file, &fileStat ) != 0 ) {
+		return false;
+	}
+	size = fileStat.st_size;
+#endif
+	return true;
+}
+
+//Offset of blocks written to a stream, which goes wherever the stream is at
+static const uint64_t streamOffset = UINT64_MAX;
+
+//Blocking read or write at offset, returns how many bytes were transferred or -1
+static int64_t transfer( bool write, AsyncFileHandle file, char* buffer, size_t length, uint64_t offset ) {
+#ifdef _WIN32
+	OVERLAPPED overlapped = {};
+	overlapped.Offset = (DWORD)offset;
+	overlapped.OffsetHigh = (DWORD)(offset >> 32);
+	OVERLAPPED* position = offset != streamOffset ? &overlapped : nullptr;
+	DWORD transferred = 0;
+	BOOL success = write ? WriteFile( file, buffer, (DWORD)length, &transferred, position ) : ReadFile( file, buffer, (DWORD)length, &transferred, position );
+	if ( !success ) {
+		return GetLastError() == ERROR_HANDLE_EOF ? 0 : -1;
+	}
+	return transferred;
+#else
+	ssize_t result;
+	do {
+		if ( offset == streamOffset ) {
+			result = write ? ::write( file, buffer, length ) : ::read( file, buffer, length );
+		}
+		else {
+			result = write ? pwrite( file, buffer, length, offset ) : pread( file, buffer, length, offset );
+		}
+	} while ( result < 0 && errno == EINTR );
+	return result;
+#endif
+}
+
+//Standard output is moved to a handle of its own and pointed at standard error instead
+//Messages printed afterwards can't end up in the middle of the data written to the returned handle
+AsyncFileHandle FileDeen::takeStandardOutput() {
+	fflush( stdout );
+#ifdef _WIN32
+	HANDLE output = INVALID_HANDLE_VALUE;
+	if ( !DuplicateHandle( GetCurrentProcess(), GetStdHandle( STD_OUTPUT_HANDLE ), GetCurrentProcess(), &output, 0, FALSE, DUPLICATE_SAME_ACCESS ) ) {
+		return invalidFile;
+	}
+	_dup2( _fileno( stderr ), _fileno( stdout ) );
+	SetStdHandle( STD_OUTPUT_HANDLE, GetStdHandle( STD_ERROR_HANDLE ) );
+	return output;
+#else
+	int output = fcntl( STDOUT_FILENO, F_DUPFD_CLOEXEC, 0 );
+	if ( output < 0 ) {
+		return invalidFile;
+	}
+	dup2( STDERR_FILENO, STDOUT_FILENO );
+	return output;
+#endif
+}
+
+
+
+//Reads and writes submitted to a queue run in the background, each one is waited for by the slot it was given
+//A queue belongs to a single reader or writer and is only used from the thread that owns it
+class FileDeen::AsyncQueue {
+public:
+	virtual ~AsyncQueue() {};
+
+	virtual bool submit( bool write, AsyncFileHandle file, char* buffer, size_t length, uint64_t offset, unsigned int slot ) = 0;
+	//Returns how many bytes the request in slot transferred, or -1 if it failed
+	virtual int64_t wait( unsigned int slot ) = 0;
+};
+
+namespace {
+	//Runs requests one after another on a thread of its own with regular blocking reads and writes
+	class ThreadQueue : public AsyncQueue {
+	public:
+		ThreadQueue( unsigned int depth ) : _results( depth, 0 ), _done( depth, false ), _stop( false ), _thread( &ThreadQueue::run, this ) {};
+
+		~ThreadQueue() {
+			{
+				std::lock_guard<std::mutex> lock( _mutex );
+				_stop = true;
+				_condition.notify_all();
+			}
+			_thread.join();
+		}
+
+		bool submit( bool write, AsyncFileHandle file, char* buffer, size_t length, uint64_t offset, unsigned int slot ) override {
+			std::lock_guard<std::mutex> lock( _mutex );
+			_requests.push_back( { write, file, buffer, length, offset, slot } );
+			_condition.notify_all();
+			return true;
+		}
+
+		int64_t wait( unsigned int slot ) override {
+			std::unique_lock<std::mutex> lock( _mutex );
+			_condition.wait( lock, [&] { return (bool)_done[slot]; } );
+			_done[slot] = false;
+			return _results[slot];
+		}
+
+	private:
+		struct Request {
+			bool write;
+			AsyncFileHandle file;
+			char* buffer;
+			size_t length;
+			uint64_t offset;
+			unsigned int slot;
+		};
+
+		void run() {
+			std::unique_lock<std::mutex> lock( _mutex );
+			while ( true ) {
+				_condition.wait( lock, [&] { return _stop || !_requests.empty(); } );
+				if ( _requests.empty() ) {
+					return;
+				}
+				Request request = _requests.front();
+				_requests.pop_front();
+				lock.unlock();
+				int64_t result = transfer( request.write, request.file, request.buffer, request.length, request.offset );
+				lock.lock();
+				_results[request.slot] = result;
+				_done[request.slot] = true;
+				_condition.notify_all();
+			}
+		}
+
+		std::deque<Request> _requests;
+		std::vector<int64_t> _results;
+		std::vector<char> _done;
+		bool _stop;
+		std::mutex _mutex;
+		std::condition_variable _condition;
+		std::thread _thread;
+	};
+
+#ifdef FILEDEEN_IO_URING
+	//Talks to io_uring through its system calls directly, so no liburing is needed to build
+	//Submission and completion rings are shared with the kernel, their heads and tails are synchronised with acquire and release
+	class IoRingQueue : public AsyncQueue {
+	public:
+		IoRingQueue() : _ring( -1 ), _submissionRing( MAP_FAILED ), _completionRing( MAP_FAILED ), _entries( MAP_FAILED ) {};
+
+		~IoRingQueue() {
+			if ( _entries != MAP_FAILED ) munmap( _entries, _entriesSize );
+			if ( _completionRing != MAP_FAILED ) munmap( _completionRing, _completionRingSize );
+			if ( _submissionRing != MAP_FAILED ) munmap( _submissionRing, _submissionRingSize );
+			if ( _ring >= 0 ) ::close( _ring );
+		}
+
+		//Fails where the kernel is too old or io_uring has been disabled
+		bool setup( unsigned int depth ) {
+			io_uring_params params;
+			memset( &params, 0, sizeof( params ) );
+			_ring = (int)syscall( __NR_io_uring_setup, depth, &params );
+			if ( _ring < 0 ) {
+				return false;
+			}
+			_submissionRingSize = params.sq_off.array + params.sq_entries*sizeof( unsigned );
+			_completionRingSize = params.cq_off.cqes + params.cq_entries*sizeof( io_uring_cqe );
+			_entriesSize = params.sq_entries*sizeof( io_uring_sqe );
+			_submissionRing = mmap( nullptr, _submissionRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring, IORING_OFF_SQ_RING );
+			_completionRing = mmap( nullptr, _completionRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring, IORING_OFF_CQ_RING );
+			_entries = mmap( nullptr, _entriesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring, IORING_OFF_SQES );
+			if ( _submissionRing == MAP_FAILED || _completionRing == MAP_FAILED || _entries == MAP_FAILED ) {
+				return false;
+			}
+			char* submissionRing = (char*)_submissionRing;
+			char* completionRing = (char*)_completionRing;
+			_submissionTail = (unsigned*)(submissionRing + params.sq_off.tail);
+			_submissionMask = *(unsigned*)(submissionRing + params.sq_off.ring_mask);
+			_submissionArray = (unsigned*)(submissionRing + params.sq_off.array);
+			_completionHead = (unsigned*)(completionRing + params.cq_off.head);
+			_completionTail = (unsigned*)(completionRing + params.cq_off.tail);
+			_completionMask = *(unsigned*)(completionRing + params.cq_off.ring_mask);
+			_completions = (io_uring_cqe*)(completionRing + params.cq_off.cqes);
+			_vectors.resize( depth );
+			_results.resize( depth, 0 );
+			_done.resize( depth, false );
+			return true;
+		}
+
+		bool submit( bool write, AsyncFileHandle file, char* buffer, size_t length, uint64_t offset, unsigned int slot ) override {
+			//Only this thread ever moves the submission tail
+			unsigned tail = *_submissionTail;
+			unsigned index = tail & _submissionMask;
+			io_uring_sqe& entry = ((io_uring_sqe*)_entries)[index];
+			memset( &entry, 0, sizeof( entry ) );
+			_vectors[slot].iov_base = buffer;
+			_vectors[slot].iov_len = length;
+			//READV and WRITEV go back further than the plain READ and WRITE operations
+			entry.opcode = write ? IORING_OP_WRITEV : IORING_OP_READV;
+			entry.fd = file;
+			entry.addr = (uint64_t)(uintptr_t)&_vectors[slot];
+			entry.len = 1;
+			entry.off = offset;
+			entry.user_data = slot;
+			_submissionArray[index] = index;
+			__atomic_store_n( _submissionTail, tail + 1, __ATOMIC_RELEASE );
+
+			while ( true ) {
+				int result = (int)syscall( __NR_io_uring_enter, _ring, 1, 0, 0, nullptr, 0 );
+				if ( result >= 1 ) {
+					return true;
+				}
+				if ( result == 0 || (errno != EINTR && errno != EAGAIN && errno != EBUSY) ) {
+					return false;
+				}
+				this->reap();
+			}
+		}
+
+		int64_t wait( unsigned int slot ) override {
+			while ( true ) {
+				this->reap();
+				if ( _done[slot] ) {
+					break;
+				}
+				int result = (int)syscall( __NR_io_uring_enter, _ring, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0 );
+				if ( result < 0 && errno != EINTR ) {
+					return -1;
+				}
+			}
+			_done[slot] = false;
+			return _results[slot];
+		}
+
+	private:
+		void reap() {
+			unsigned head = *_completionHead;
+			unsigned tail = __atomic_load_n( _completionTail, __ATOMIC_ACQUIRE );
+			while ( head != tail ) {
+				const io_uring_cqe& completion = _completions[head & _completionMask];
+				_results[completion.user_data] = completion.res < 0 ? -1 : completion.res;
+				_done[completion.user_data] = true;
+				head++;
+			}
+			__atomic_store_n( _completionHead, head, __ATOMIC_RELEASE );
+		}
+
+		int _ring;
+		void* _submissionRing;
+		void* _completionRing;
+		void* _entries;
+		size_t _submissionRingSize, _completionRingSize, _entriesSize;
+		unsigned* _submissionTail;
+		unsigned* _submissionArray;
+		unsigned _submissionMask;
+		unsigned* _completionHead;
+		unsigned* _completionTail;
+		unsigned _completionMask;
+		io_uring_cqe* _completions;
+		std::vector<iovec> _vectors;
+		std::vector<int64_t> _results;
+		std::vector<char> _done;
+	};
+#endif
+}
+
+static std::atomic<bool> ioRingEnabled( true );
+
+bool FileDeen::ioRingAvailable() {
+#ifdef FILEDEEN_IO_URING
+	static const bool available = [] {
+		IoRingQueue ring;
+		return ring.setup( 1 );
+	}();
+	return available;
+#else
+	return false;
+#endif
+}
+
+void FileDeen::setIoRingEnabled( bool enabled ) {
+	ioRingEnabled = enabled;
+}
+
+const char* FileDeen::asyncBackendName() {
+	return ioRingEnabled && ioRingAvailable() ? "io_uring" : "threads";
+}
+
+static std::unique_ptr<AsyncQueue> createQueue( unsigned int depth ) {
+#ifdef FILEDEEN_IO_URING
+	if ( ioRingEnabled ) {
+		std::unique_ptr<IoRingQueue> ring( new IoRingQueue() );
+		if ( ring->setup( depth ) ) {
+			return ring;
+		}
+	}
+#endif
+	return std::unique_ptr<AsyncQueue>( new ThreadQueue( depth ) );
+}
+
+
+
+AsyncFileReader::AsyncFileReader( unsigned int depth ) : _blocks( std::max( depth, 1u ) ), _file( invalidFile ), _size( 0 ), _nextOffset( 0 ), _head( 0 ), _failed( false ) {
+}
+
+AsyncFileReader::~AsyncFileReader() {
+	this->close();
+}
+
+bool AsyncFileReader::open( const std::filesystem::path& fileName ) {
+	this->close();
+	_file = openFile( fileName, false, false );
+	if ( _file == invalidFile ) {
+		return false;
+	}
+	if ( !fileSize( _file, _size ) ) {
+		this->close();
+		return false;
+	}
+	_nextOffset = 0;
+	_head = 0;
+	_failed = false;
+
+	if ( _size <= asyncBlockSize ) {
+		Block& block = _blocks[0];
+		block.data.resize( asyncBlockSize );
+		block.offset = 0;
+		block.position = 0;
+		block.length = 0;
+		while ( block.length < _size ) {
+			int64_t result = transfer( false, _file, &block.data[block.length], (size_t)_size - block.length, block.length );
+			if ( result <= 0 ) {
+				_failed = result < 0;
+				break;
+			}
+			block.length += (size_t)result;
+		}
+		block.ready = true;
+		_nextOffset = _size;
+		return true;
+	}
+
+	for ( unsigned int i = 0; i < _blocks.size() && _nextOffset < _size; i++ ) {
+		this->submitBlock( i );
+	}
+	return true;
+}
+
+void AsyncFileReader::close() {
+	for ( unsigned int i = 0; i < _blocks.size(); i++ ) {
+		Block& block = _blocks[i];
+		if ( block.inFlight ) {
+			_queue->wait( i );
+		}
+		block.inFlight = block.ready = false;
+	}
+	if ( _file != invalidFile ) {
+		closeFile( _file );
+	}
+	_file = invalidFile;
+	_size = _nextOffset = 0;
+}
+
+void AsyncFileReader::submitBlock( unsigned int slot ) {
+	Block& block = _blocks[slot];
+	block.data.resize( asyncBlockSize );
+	block.offset = _nextOffset;
+	block.length = (size_t)std::min<uint64_t>( asyncBlockSize, _size - _nextOffset );
+	block.position = 0;
+	_nextOffset += block.length;
+	if ( _queue == nullptr ) {
+		_queue = createQueue( (unsigned int)_blocks.size() );
+	}
+	if ( _queue->submit( false, _file, &block.data[0], block.length, block.offset, slot ) ) {
+		block.inFlight = true;
+	}
+	else {
+		_failed = true;
+		block.length = 0;
+		block.ready = true;
+	}
+}
+
+//Returns false if there is nothing left to read in the block
+bool AsyncFileReader::waitBlock( unsigned int slot ) {
+	Block& block = _blocks[slot];
+	if ( block.ready ) {
+		return true;
+	}
+	if ( !block.inFlight ) {
+		return false;
+	}
+	int64_t result = _queue->wait( slot );
+	block.inFlight = false;
+
+	//Reads may come up short and are finished off in place, a file that shrank ends early
+	size_t length = result > 0 ? (size_t)result : 0;
+	while ( result > 0 && length < block.length ) {
+		result = transfer( false, _file, &block.data[length], block.length - length, block.offset + length );
+		if ( result > 0 ) {
+			length += (size_t)result;
+		}
+	}
+	if ( result < 0 ) {
+		_failed = true;
+	}
+	block.length = length;
+	block.ready = true;
+	return true;
+}
+
+size_t AsyncFileReader::peek( char* destination, size_t length ) {
+	if ( !this->waitBlock( _head ) ) {
+		return 0;
+	}
+	Block& block = _blocks[_head];
+	length = std::min( length, block.length - block.position );
+	if ( length > 0 ) {
+		memcpy( destination, &block.data[block.position], length );
+	}
+	return length;
+}
+
+size_t AsyncFileReader::read( char* destination, size_t length ) {
+	size_t copied = 0;
+	while ( copied < length && this->waitBlock( _head ) ) {
+		Block& block = _blocks[_head];
+		size_t copyLength = std::min( length - copied, block.length - block.position );
+		memcpy( destination + copied, &block.data[block.position], copyLength );
+		block.position += copyLength;
+		copied += copyLength;
+		if ( block.position < block.length ) {
+			break;
+		}
+
+		//Refill the block with the next part of the file as soon as it's used up
+		block.ready = false;
+		bool shortBlock = block.length < asyncBlockSize;
+		if ( _nextOffset < _size && !shortBlock ) {
+			this->submitBlock( _head );
+		}
+		_head = (_head + 1) % _blocks.size();
+		if ( shortBlock ) {
+			break;
+		}
+	}
+	return copied;
+}
+
+
+
+AsyncFileWriter::AsyncFileWriter( unsigned int depth ) : _blocks( std::max( depth, 1u ) ), _file( invalidFile ), _position( 0 ), _current( 0 ), _failed( false ), _direct( false ),
+	_stream( false ) {
+}
+
+AsyncFileWriter::~AsyncFileWriter() {
+	this->close();
+	this->finish();
+}
+
+bool AsyncFileWriter::open( const std::filesystem::path& fileName, bool truncate, bool direct ) {
+	this->close();
+	_file = direct ? openFile( fileName, true, truncate, true ) : invalidFile;
+	_direct = _file != invalidFile;
+	if ( _file == invalidFile ) {
+		_file = openFile( fileName, true, truncate );
+	}
+	_stream = false;
+	_position = 0;
+	return _file != invalidFile;
+}
+
+//Blocks are written one after another by a thread, io_uring could start a block before the one ahead of it is done
+bool AsyncFileWriter::open( AsyncFileHandle stream ) {
+	this->close();
+	if ( stream == invalidFile ) {
+		return false;
+	}
+	this->waitAll();
+	_queue.reset( new ThreadQueue( (unsigned int)_blocks.size() ) );
+	_file = stream;
+	_direct = false;
+	_stream = true;
+	_position = 0;
+	return true;
+}
+
+int AsyncFileWriter::close() {
+	if ( _file == invalidFile ) {
+		return _failed ? 1 : 0;
+	}
+	Block& block = _blocks[_current];
+	Block& previous = _blocks[(_current + _blocks.size() - 1) % _blocks.size()];
+	if ( block.length > 0 ) {
+		block.closeFile = true;
+		block.fileLength = _position;
+		this->submitBlock();
+	}
+	else if ( previous.inFlight && previous.file == _file ) {
+		previous.closeFile = true;
+		previous.fileLength = _position;
+	}
+	else {
+		if ( _direct && !setFileLength( _file, _position ) ) {
+			_failed = true;
+		}
+		closeFile( _file );
+	}
+	_file = invalidFile;
+	_direct = false;
+	_stream = false;
+	return _failed ? 1 : 0;
+}
+
+int AsyncFileWriter::finish() {
+	this->waitAll();
+	bool failed = _failed;
+	_failed = false;
+	return failed ? 1 : 0;
+}
+
+//Fails silently, the file simply grows as it's written like it would have without it
+void AsyncFileWriter::preallocate( uint64_t length ) {
+	if ( _file == invalidFile || _stream || length == 0 ) {
+		return;
+	}
+#ifdef _WIN32
+	FILE_ALLOCATION_INFO allocation;
+	allocation.AllocationSize.QuadPart = (LONGLONG)length;
+	SetFileInformationByHandle( _file, FileAllocationInfo, &allocation, sizeof( allocation ) );
+#elif defined( __linux__ )
+	int result;
+	do {
+		result = fallocate( _file, FALLOC_FL_KEEP_SIZE, 0, (off_t)length );
+	} while ( result != 0 && errno == EINTR );
+#endif
+}
+
+void AsyncFileWriter::write( const char* data, size_t length ) {
+	if ( _file == invalidFile ) {
+		_failed = _failed || length > 0;
+		return;
+	}
+	while ( length > 0 ) {
+		Block& block = _blocks[_current];
+		if ( block.buffer == nullptr ) {
+			block.data.resize( asyncBlockSize + directAlignment );
+			uintptr_t start = (uintptr_t)block.data.data();
+			block.buffer = block.data.data() + ((directAlignment - start % directAlignment) % directAlignment);
+		}
+		if ( block.length == 0 ) {
+			block.offset = _stream ? streamOffset : _position;
+		}
+		size_t copyLength = std::min( length, asyncBlockSize - block.length );
+		memcpy( block.buffer + block.length, data, copyLength );
+		block.length += copyLength;
+		_position += copyLength;
+		data += copyLength;
+		length -= copyLength;
+		if ( block.length == asyncBlockSize ) {
+			this->submitBlock();
+		}
+	}
+}
+
+void AsyncFileWriter::writeAt( uint64_t offset, const char* data, size_t length ) {
+	this->waitAll();
+	if ( _stream ) {
+		_failed = true;
+		return;
+	}
+	while ( length > 0 ) {
+		int64_t result = transfer( true, _file, (char*)data, length, offset );
+		if ( result <= 0 ) {
+			_failed = true;
+			return;
+		}
+		data += result;
+		length -= (size_t)result;
+		offset += result;
+	}
+}
+
+void AsyncFileWriter::seek( uint64_t offset ) {
+	this->waitAll();
+	_failed = _failed || _stream;
+	_position = offset;
+}
+
+//Sends off the block being filled, and makes sure the next one is free to be filled
+void AsyncFileWriter::submitBlock() {
+	Block& block = _blocks[_current];
+	if ( block.length == 0 ) {
+		return;
+	}
+	block.file = _file;
+	block.direct = _direct;
+	if ( _direct ) {
+		//Cut back off when the file is closed
+		size_t paddedLength = (block.length + directAlignment - 1) / directAlignment * directAlignment;
+		memset( block.buffer + block.length, 0, paddedLength - block.length );
+		block.length = paddedLength;
+	}
+	if ( _queue == nullptr ) {
+		_queue = createQueue( (unsigned int)_blocks.size() );
+	}
+	if ( _queue->submit( true, block.file, block.buffer, block.length, block.offset, _current ) ) {
+		block.inFlight = true;
+	}
+	else {
+		_failed = true;
+		block.length = 0;
+	}
+	_current = (_current + 1) % _blocks.size();
+	this->waitBlock( _current );
+}
+
+void AsyncFileWriter::waitBlock( unsigned int slot ) {
+	Block& block = _blocks[slot];
+	if ( block.inFlight ) {
+		int64_t result = _queue->wait( slot );
+		block.inFlight = false;
+
+		//Writes may come up short and are finished off in place
+		size_t length = result > 0 ? (size_t)result : 0;
+		while ( result > 0 && length < block.length ) {
+			uint64_t offset = block.offset != streamOffset ? block.offset + length : streamOffset;
+			result = transfer( true, block.file, block.buffer + length, block.length - length, offset );
+			if ( result > 0 ) {
+				length += (size_t)result;
+			}
+		}
+		if ( length < block.length ) {
+			_failed = true;
+		}
+		block.length = 0;
+	}
+	if ( block.closeFile ) {
+		if ( block.direct && !setFileLength( block.file, block.fileLength ) ) {
+			_failed = true;
+		}
+		closeFile( block.file );
+		block.closeFile = false;
+	}
+}
+
+//Blocks are waited for oldest first, so a file is only closed after every block written to it
+void AsyncFileWriter::waitAll() {
+	this->submitBlock();
+	for ( unsigned int i = 0; i < _blocks.size(); i++ ) {
+		this->waitBlock( (_current + i) % _blocks.size() );
+	}
+}
+
+
+
+//A folder that has been made once is taken to still be there
+bool DirectoryCache::create( const std::filesystem::path& folder ) {
+	if ( folder.empty() ) {
+		return true;
+	}
+	{
+		std::lock_guard<std::mutex> lock( _mutex );
+		if ( _folders.count( folder.native() ) > 0 ) {
+			return true;
+		}
+	}
+	std::error_code error;
+	std::filesystem::create_directories( folder, error );
+	if ( error ) {
+		return false;
+	}
+	std::lock_guard<std::mutex> lock( _mutex );
+	_folders.insert( folder.native() );
+	return true;
+}
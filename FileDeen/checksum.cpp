@@ -0,0 +1,114 @@
+#include <cstring>
+#include "checksum.h"
+
+#if defined( _M_X64 ) || defined( _M_IX86 ) || defined( __x86_64__ ) || defined( __i386__ )
+#define FILEDEEN_X86
+#include <nmmintrin.h>
+#if defined( _MSC_VER )
+#include <intrin.h>
+#define FILEDEEN_TARGET( isa )
+#else
+#include <cpuid.h>
+#define FILEDEEN_TARGET( isa ) __attribute__(( target( isa ) ))
+#endif
+#endif
+
+using namespace FileDeen;
+
+//Reflected Castagnoli polynomial
+const uint32_t polynomial = 0x82F63B78;
+
+//Slicing by 8, table[k][b] is the CRC of byte b followed by k zero bytes
+struct CRCTables {
+	uint32_t table[8][256];
+
+	CRCTables() {
+		for ( uint32_t byte = 0; byte < 256; byte++ ) {
+			uint32_t crc = byte;
+			for ( int bit = 0; bit < 8; bit++ ) {
+				crc = (crc >> 1) ^ (crc & 1 ? polynomial : 0);
+			}
+			table[0][byte] = crc;
+		}
+		for ( int k = 1; k < 8; k++ ) {
+			for ( int byte = 0; byte < 256; byte++ ) {
+				table[k][byte] = (table[k-1][byte] >> 8) ^ table[0][table[k-1][byte] & 0xFF];
+			}
+		}
+	}
+};
+
+static uint32_t crc32cSoftware( uint32_t crc, const unsigned char* data, size_t length ) {
+	static const CRCTables tables;
+	const auto& table = tables.table;
+	while ( length >= 8 ) {
+		uint32_t low, high;
+		memcpy( &low, data, sizeof( low ) );
+		memcpy( &high, data+4, sizeof( high ) );
+		low ^= crc;
+		crc = table[7][low & 0xFF] ^ table[6][(low >> 8) & 0xFF] ^ table[5][(low >> 16) & 0xFF] ^ table[4][low >> 24] ^
+			table[3][high & 0xFF] ^ table[2][(high >> 8) & 0xFF] ^ table[1][(high >> 16) & 0xFF] ^ table[0][high >> 24];
+		data += 8;
+		length -= 8;
+	}
+	while ( length-- > 0 ) {
+		crc = (crc >> 8) ^ table[0][(crc ^ *data++) & 0xFF];
+	}
+	return crc;
+}
+
+#ifdef FILEDEEN_X86
+FILEDEEN_TARGET( "sse4.2" ) static uint32_t crc32cSSE42( uint32_t crc, const unsigned char* data, size_t length ) {
+#if defined( _M_X64 ) || defined( __x86_64__ )
+	uint64_t wideCrc = crc;
+	while ( length >= 8 ) {
+		uint64_t value;
+		memcpy( &value, data, sizeof( value ) );
+		wideCrc = _mm_crc32_u64( wideCrc, value );
+		data += 8;
+		length -= 8;
+	}
+	crc = (uint32_t)wideCrc;
+#endif
+	while ( length >= 4 ) {
+		uint32_t value;
+		memcpy( &value, data, sizeof( value ) );
+		crc = _mm_crc32_u32( crc, value );
+		data += 4;
+		length -= 4;
+	}
+	while ( length-- > 0 ) {
+		crc = _mm_crc32_u8( crc, *data++ );
+	}
+	return crc;
+}
+
+static bool detectSSE42() {
+	unsigned int registers[4];
+#if defined( _MSC_VER )
+	__cpuid( (int*)registers, 1 );
+#else
+	__cpuid( 1, registers[0], registers[1], registers[2], registers[3] );
+#endif
+	return (registers[2] >> 20) & 1;
+}
+#endif
+
+bool FileDeen::hardwareChecksum() {
+#ifdef FILEDEEN_X86
+	static const bool sse42 = detectSSE42();
+	return sse42;
+#else
+	return false;
+#endif
+}
+
+uint32_t FileDeen::crc32c( uint32_t crc, const char* data, size_t length ) {
+	crc = ~crc;
+#ifdef FILEDEEN_X86
+	if ( hardwareChecksum() ) {
+		return ~crc32cSSE42( crc, (const unsigned char*)data, length );
+	}
+#endif
+	return ~crc32cSoftware( crc, (const unsigned char*)data, length );
+}
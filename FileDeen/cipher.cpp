@@ -0,0 +1,641 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include "cipher.h"
+
+#if defined( _M_X64 ) || defined( _M_IX86 ) || defined( __x86_64__ ) || defined( __i386__ )
+#define FILEDEEN_X86
+#include <immintrin.h>
+#if defined( _MSC_VER )
+#include <intrin.h>
+#define FILEDEEN_TARGET( isa )
+#else
+#include <cpuid.h>
+#define FILEDEEN_TARGET( isa ) __attribute__(( target( isa ) ))
+#endif
+#endif
+
+using namespace FileDeen;
+
+static_assert( blockSize == 64 && blockMaskSize == blockSize*2, "Block kernels are written for 64 byte blocks" );
+static_assert( cipherStateSize >= blockMaskSize, "Cipher state has to hold the block masks" );
+
+static std::atomic<uint64_t> keySetupCount( 0 ), keySetupNanoseconds( 0 );
+
+static const unsigned char aesSbox[256] = {
+	0x63, 0x7C, 0x77, 0x7B, 0xF2, 0x6B, 0x6F, 0xC5, 0x30, 0x01, 0x67, 0x2B, 0xFE, 0xD7, 0xAB, 0x76,
+	0xCA, 0x82, 0xC9, 0x7D, 0xFA, 0x59, 0x47, 0xF0, 0xAD, 0xD4, 0xA2, 0xAF, 0x9C, 0xA4, 0x72, 0xC0,
+	0xB7, 0xFD, 0x93, 0x26, 0x36, 0x3F, 0xF7, 0xCC, 0x34, 0xA5, 0xE5, 0xF1, 0x71, 0xD8, 0x31, 0x15,
+	0x04, 0xC7, 0x23, 0xC3, 0x18, 0x96, 0x05, 0x9A, 0x07, 0x12, 0x80, 0xE2, 0xEB, 0x27, 0xB2, 0x75,
+	0x09, 0x83, 0x2C, 0x1A, 0x1B, 0x6E, 0x5A, 0xA0, 0x52, 0x3B, 0xD6, 0xB3, 0x29, 0xE3, 0x2F, 0x84,
+	0x53, 0xD1, 0x00, 0xED, 0x20, 0xFC, 0xB1, 0x5B, 0x6A, 0xCB, 0xBE, 0x39, 0x4A, 0x4C, 0x58, 0xCF,
+	0xD0, 0xEF, 0xAA, 0xFB, 0x43, 0x4D, 0x33, 0x85, 0x45, 0xF9, 0x02, 0x7F, 0x50, 0x3C, 0x9F, 0xA8,
+	0x51, 0xA3, 0x40, 0x8F, 0x92, 0x9D, 0x38, 0xF5, 0xBC, 0xB6, 0xDA, 0x21, 0x10, 0xFF, 0xF3, 0xD2,
+	0xCD, 0x0C, 0x13, 0xEC, 0x5F, 0x97, 0x44, 0x17, 0xC4, 0xA7, 0x7E, 0x3D, 0x64, 0x5D, 0x19, 0x73,
+	0x60, 0x81, 0x4F, 0xDC, 0x22, 0x2A, 0x90, 0x88, 0x46, 0xEE, 0xB8, 0x14, 0xDE, 0x5E, 0x0B, 0xDB,
+	0xE0, 0x32, 0x3A, 0x0A, 0x49, 0x06, 0x24, 0x5C, 0xC2, 0xD3, 0xAC, 0x62, 0x91, 0x95, 0xE4, 0x79,
+	0xE7, 0xC8, 0x37, 0x6D, 0x8D, 0xD5, 0x4E, 0xA9, 0x6C, 0x56, 0xF4, 0xEA, 0x65, 0x7A, 0xAE, 0x08,
+	0xBA, 0x78, 0x25, 0x2E, 0x1C, 0xA6, 0xB4, 0xC6, 0xE8, 0xDD, 0x74, 0x1F, 0x4B, 0xBD, 0x8B, 0x8A,
+	0x70, 0x3E, 0xB5, 0x66, 0x48, 0x03, 0xF6, 0x0E, 0x61, 0x35, 0x57, 0xB9, 0x86, 0xC1, 0x1D, 0x9E,
+	0xE1, 0xF8, 0x98, 0x11, 0x69, 0xD9, 0x8E, 0x94, 0x9B, 0x1E, 0x87, 0xE9, 0xCE, 0x55, 0x28, 0xDF,
+	0x8C, 0xA1, 0x89, 0x0D, 0xBF, 0xE6, 0x42, 0x68, 0x41, 0x99, 0x2D, 0x0F, 0xB0, 0x54, 0xBB, 0x16
+};
+
+//AES-256 key expansion, round keys are stored as the bytes each round XORs into the state
+static void expandAesKey( const unsigned char* key, unsigned char* roundKeys ) {
+	const int keyWords = 8;
+	unsigned char roundConstant = 0x01;
+	memcpy( roundKeys, key, keyWords*4 );
+	for ( int i = keyWords; i < aesRoundKeysSize/4; i++ ) {
+		unsigned char word[4];
+		memcpy( word, &roundKeys[(i-1)*4], 4 );
+		if ( i % keyWords == 0 ) {
+			unsigned char first = word[0];
+			word[0] = aesSbox[word[1]] ^ roundConstant;
+			word[1] = aesSbox[word[2]];
+			word[2] = aesSbox[word[3]];
+			word[3] = aesSbox[first];
+			roundConstant = (unsigned char)((roundConstant << 1) ^ (roundConstant & 0x80 ? 0x1B : 0));
+		}
+		else if ( i % keyWords == 4 ) {
+			for ( int j = 0; j < 4; j++ ) {
+				word[j] = aesSbox[word[j]];
+			}
+		}
+		for ( int j = 0; j < 4; j++ ) {
+			roundKeys[i*4+j] = roundKeys[(i-keyWords)*4+j] ^ word[j];
+		}
+	}
+}
+
+//Generate potentially cryptographically insecure pseudorandom 512-bit key from given key
+//The next value from the generator is the byte used to pad data up to the block size, and the 32 after it are the AES key
+KeyContext::KeyContext( std::string key ) {
+	auto start = std::chrono::steady_clock::now();
+	if ( key.length() == 0 ) {
+		key = "DEFAULT";
+	}
+	std::seed_seq seed( key.begin(), key.end() );
+	std::mt19937_64 rng( seed );
+	std::uniform_int_distribution<short> dist( 0x00u, 0xFFu );
+	for ( int i = 0; i < blockSize; i++ ) {
+		_randKey[i] = dist( rng );
+	}
+	_paddingByte = rng();
+	unsigned char aesKey[32];
+	for ( int i = 0; i < 32; i++ ) {
+		aesKey[i] = (unsigned char)dist( rng );
+	}
+	expandAesKey( aesKey, _aesRoundKeys );
+
+	keySetupCount++;
+	keySetupNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - start ).count();
+}
+
+void KeyContext::buildBlockMasks( const char* initVector, char* masks ) const {
+	for ( int i = 0; i < blockSize; i++ ) {
+		masks[i] = initVector[i] ^ _randKey[i];
+		masks[blockSize+i] = initVector[i];
+	}
+}
+
+KeySetupStats KeyContext::setupStats() {
+	return { keySetupCount, keySetupNanoseconds };
+}
+
+//In the v5 transform each byte's chaining value only ever gets XORed with the key byte at the same block position,
+//so block n is simply XORed with (initVector ^ randKey) when n is even and with initVector when n is odd.
+//Both directions are the same XOR, and every block can be processed on its own without any per-byte state.
+
+//Each kernel XORs 'blocks' whole blocks from source into destination, the first of which has the parity given by oddFirst
+//source and destination may be the same buffer
+typedef void ( *BlockKernel )( const char* source, char* destination, size_t blocks, bool oddFirst, const char* masks );
+
+static void xorBlocksScalar( const char* source, char* destination, size_t blocks, bool oddFirst, const char* masks ) {
+	uint64_t mask[2][8];
+	memcpy( mask, masks, sizeof( mask ) );
+	for ( size_t block = 0; block < blocks; block++ ) {
+		const uint64_t* blockMask = mask[(block + oddFirst) & 1];
+		for ( int word = 0; word < 8; word++ ) {
+			uint64_t value;
+			memcpy( &value, source + word*8, 8 );
+			value ^= blockMask[word];
+			memcpy( destination + word*8, &value, 8 );
+		}
+		source += 64;
+		destination += 64;
+	}
+}
+
+#ifdef FILEDEEN_X86
+FILEDEEN_TARGET( "sse2" ) static void xorBlocksSSE2( const char* source, char* destination, size_t blocks, bool oddFirst, const char* masks ) {
+	__m128i mask[2][4];
+	for ( int i = 0; i < 4; i++ ) {
+		mask[0][i] = _mm_loadu_si128( (const __m128i*)(masks + i*16) );
+		mask[1][i] = _mm_loadu_si128( (const __m128i*)(masks + 64 + i*16) );
+	}
+	for ( size_t block = 0; block < blocks; block++ ) {
+		const __m128i* blockMask = mask[(block + oddFirst) & 1];
+		for ( int i = 0; i < 4; i++ ) {
+			__m128i value = _mm_loadu_si128( (const __m128i*)(source + i*16) );
+			_mm_storeu_si128( (__m128i*)(destination + i*16), _mm_xor_si128( value, blockMask[i] ) );
+		}
+		source += 64;
+		destination += 64;
+	}
+}
+
+FILEDEEN_TARGET( "avx2" ) static void xorBlocksAVX2( const char* source, char* destination, size_t blocks, bool oddFirst, const char* masks ) {
+	__m256i mask[4] = {
+		_mm256_loadu_si256( (const __m256i*)(masks + (oddFirst ? 64 : 0)) ),
+		_mm256_loadu_si256( (const __m256i*)(masks + (oddFirst ? 96 : 32)) ),
+		_mm256_loadu_si256( (const __m256i*)(masks + (oddFirst ? 0 : 64)) ),
+		_mm256_loadu_si256( (const __m256i*)(masks + (oddFirst ? 32 : 96)) )
+	};
+	size_t block = 0;
+	for ( ; block + 2 <= blocks; block += 2 ) {
+		for ( int i = 0; i < 4; i++ ) {
+			__m256i value = _mm256_loadu_si256( (const __m256i*)source + i );
+			_mm256_storeu_si256( (__m256i*)destination + i, _mm256_xor_si256( value, mask[i] ) );
+		}
+		source += 128;
+		destination += 128;
+	}
+	if ( block < blocks ) {
+		for ( int i = 0; i < 2; i++ ) {
+			__m256i value = _mm256_loadu_si256( (const __m256i*)source + i );
+			_mm256_storeu_si256( (__m256i*)destination + i, _mm256_xor_si256( value, mask[i] ) );
+		}
+	}
+}
+
+FILEDEEN_TARGET( "avx512f" ) static void xorBlocksAVX512( const char* source, char* destination, size_t blocks, bool oddFirst, const char* masks ) {
+	__m512i first = _mm512_loadu_si512( masks + (oddFirst ? 64 : 0) ),
+		second = _mm512_loadu_si512( masks + (oddFirst ? 0 : 64) );
+	size_t block = 0;
+	for ( ; block + 2 <= blocks; block += 2 ) {
+		_mm512_storeu_si512( destination, _mm512_xor_si512( _mm512_loadu_si512( source ), first ) );
+		_mm512_storeu_si512( destination + 64, _mm512_xor_si512( _mm512_loadu_si512( source + 64 ), second ) );
+		source += 128;
+		destination += 128;
+	}
+	if ( block < blocks ) {
+		_mm512_storeu_si512( destination, _mm512_xor_si512( _mm512_loadu_si512( source ), first ) );
+	}
+}
+
+#endif
+
+//Counter mode kernels encrypt 'blocks' counter blocks, the first of which is number 'block' of the entry, and XOR them from source into destination
+//counter is the entry's first counter block, only its last 8 bytes count, see CipherScheme::AESCTR
+typedef void ( *AesKernel )( const unsigned char* roundKeys, const unsigned char* counter, uint64_t block, const char* source, char* destination, size_t blocks );
+
+static uint64_t loadBigEndian64( const unsigned char* data ) {
+	uint64_t value = 0;
+	for ( int i = 0; i < 8; i++ ) {
+		value = (value << 8) | data[i];
+	}
+	return value;
+}
+
+//Lookup tables combining SubBytes, ShiftRows and MixColumns, one per byte of a column, built the first time they're needed
+namespace {
+	struct AesTables {
+		uint32_t rounds[4][256];
+
+		AesTables() {
+			for ( int x = 0; x < 256; x++ ) {
+				uint32_t value = aesSbox[x], doubled = (value << 1) ^ (value & 0x80 ? 0x11B : 0);
+				uint32_t column = (doubled << 24) | (value << 16) | (value << 8) | (doubled ^ value);
+				for ( int i = 0; i < 4; i++ ) {
+					rounds[i][x] = i == 0 ? column : (column >> (8*i)) | (column << (32 - 8*i));
+				}
+			}
+		}
+	};
+}
+
+static void aesCtrScalar( const unsigned char* roundKeys, const unsigned char* counter, uint64_t block, const char* source, char* destination, size_t blocks ) {
+	static const AesTables tables;
+	const uint32_t ( &t )[4][256] = tables.rounds;
+	uint32_t keys[aesRoundKeysSize/4];
+	for ( int i = 0; i < aesRoundKeysSize/4; i++ ) {
+		keys[i] = (uint32_t)roundKeys[i*4] << 24 | (uint32_t)roundKeys[i*4+1] << 16 | (uint32_t)roundKeys[i*4+2] << 8 | roundKeys[i*4+3];
+	}
+	uint32_t nonce[2] = {
+		(uint32_t)counter[0] << 24 | (uint32_t)counter[1] << 16 | (uint32_t)counter[2] << 8 | counter[3],
+		(uint32_t)counter[4] << 24 | (uint32_t)counter[5] << 16 | (uint32_t)counter[6] << 8 | counter[7]
+	};
+	uint64_t start = loadBigEndian64( counter + 8 ) + block;
+
+	for ( size_t i = 0; i < blocks; i++ ) {
+		uint64_t number = start + i;
+		uint32_t s0 = nonce[0] ^ keys[0], s1 = nonce[1] ^ keys[1], s2 = (uint32_t)(number >> 32) ^ keys[2], s3 = (uint32_t)number ^ keys[3];
+		for ( int round = 1; round < 14; round++ ) {
+			const uint32_t* key = &keys[round*4];
+			uint32_t t0 = t[0][s0 >> 24] ^ t[1][(s1 >> 16) & 0xFF] ^ t[2][(s2 >> 8) & 0xFF] ^ t[3][s3 & 0xFF] ^ key[0],
+				t1 = t[0][s1 >> 24] ^ t[1][(s2 >> 16) & 0xFF] ^ t[2][(s3 >> 8) & 0xFF] ^ t[3][s0 & 0xFF] ^ key[1],
+				t2 = t[0][s2 >> 24] ^ t[1][(s3 >> 16) & 0xFF] ^ t[2][(s0 >> 8) & 0xFF] ^ t[3][s1 & 0xFF] ^ key[2],
+				t3 = t[0][s3 >> 24] ^ t[1][(s0 >> 16) & 0xFF] ^ t[2][(s1 >> 8) & 0xFF] ^ t[3][s2 & 0xFF] ^ key[3];
+			s0 = t0;
+			s1 = t1;
+			s2 = t2;
+			s3 = t3;
+		}
+		//Last round has no MixColumns
+		uint32_t state[4] = { s0, s1, s2, s3 };
+		unsigned char keystream[aesBlockSize];
+		for ( int column = 0; column < 4; column++ ) {
+			uint32_t value = (uint32_t)aesSbox[state[column] >> 24] << 24 | (uint32_t)aesSbox[(state[(column+1) % 4] >> 16) & 0xFF] << 16 |
+				(uint32_t)aesSbox[(state[(column+2) % 4] >> 8) & 0xFF] << 8 | aesSbox[state[(column+3) % 4] & 0xFF];
+			value ^= keys[56+column];
+			for ( int j = 0; j < 4; j++ ) {
+				keystream[column*4+j] = (unsigned char)(value >> (24 - 8*j));
+			}
+		}
+		for ( int j = 0; j < aesBlockSize; j++ ) {
+			destination[j] = source[j] ^ keystream[j];
+		}
+		source += aesBlockSize;
+		destination += aesBlockSize;
+	}
+}
+
+#ifdef FILEDEEN_X86
+static uint64_t byteSwap64( uint64_t value ) {
+#if defined( _MSC_VER )
+	return _byteswap_uint64( value );
+#else
+	return __builtin_bswap64( value );
+#endif
+}
+
+//Eight blocks at a time keep the AES unit busy, each round of a block depends on the one before it
+FILEDEEN_TARGET( "aes" ) static void aesCtrNI( const unsigned char* roundKeys, const unsigned char* counter, uint64_t block, const char* source, char* destination, size_t blocks ) {
+	__m128i keys[15];
+	for ( int i = 0; i < 15; i++ ) {
+		keys[i] = _mm_loadu_si128( (const __m128i*)(roundKeys + i*16) );
+	}
+	long long nonce;
+	memcpy( &nonce, counter, sizeof( nonce ) );
+	uint64_t start = loadBigEndian64( counter + 8 ) + block;
+
+	size_t i = 0;
+	for ( ; i + 8 <= blocks; i += 8 ) {
+		__m128i x[8];
+		for ( int j = 0; j < 8; j++ ) {
+			x[j] = _mm_xor_si128( _mm_set_epi64x( (long long)byteSwap64( start + i + j ), nonce ), keys[0] );
+		}
+		for ( int round = 1; round < 14; round++ ) {
+			for ( int j = 0; j < 8; j++ ) {
+				x[j] = _mm_aesenc_si128( x[j], keys[round] );
+			}
+		}
+		for ( int j = 0; j < 8; j++ ) {
+			x[j] = _mm_aesenclast_si128( x[j], keys[14] );
+			__m128i value = _mm_loadu_si128( (const __m128i*)(source + j*16) );
+			_mm_storeu_si128( (__m128i*)(destination + j*16), _mm_xor_si128( value, x[j] ) );
+		}
+		source += 128;
+		destination += 128;
+	}
+	for ( ; i < blocks; i++ ) {
+		__m128i x = _mm_xor_si128( _mm_set_epi64x( (long long)byteSwap64( start + i ), nonce ), keys[0] );
+		for ( int round = 1; round < 14; round++ ) {
+			x = _mm_aesenc_si128( x, keys[round] );
+		}
+		x = _mm_aesenclast_si128( x, keys[14] );
+		_mm_storeu_si128( (__m128i*)destination, _mm_xor_si128( _mm_loadu_si128( (const __m128i*)source ), x ) );
+		source += 16;
+		destination += 16;
+	}
+}
+
+//VAES runs the same rounds on two or four blocks per instruction, blocks left over go through AES-NI
+FILEDEEN_TARGET( "avx2,aes,vaes" ) static void aesCtrVAES256( const unsigned char* roundKeys, const unsigned char* counter, uint64_t block, const char* source, char* destination, size_t blocks ) {
+	__m256i keys[15];
+	for ( int i = 0; i < 15; i++ ) {
+		keys[i] = _mm256_broadcastsi128_si256( _mm_loadu_si128( (const __m128i*)(roundKeys + i*16) ) );
+	}
+	long long nonce;
+	memcpy( &nonce, counter, sizeof( nonce ) );
+	uint64_t start = loadBigEndian64( counter + 8 ) + block;
+
+	size_t i = 0;
+	for ( ; i + 8 <= blocks; i += 8 ) {
+		__m256i x[4];
+		for ( int j = 0; j < 4; j++ ) {
+			uint64_t number = start + i + j*2;
+			x[j] = _mm256_xor_si256( _mm256_set_epi64x( (long long)byteSwap64( number + 1 ), nonce, (long long)byteSwap64( number ), nonce ), keys[0] );
+		}
+		for ( int round = 1; round < 14; round++ ) {
+			for ( int j = 0; j < 4; j++ ) {
+				x[j] = _mm256_aesenc_epi128( x[j], keys[round] );
+			}
+		}
+		for ( int j = 0; j < 4; j++ ) {
+			x[j] = _mm256_aesenclast_epi128( x[j], keys[14] );
+			__m256i value = _mm256_loadu_si256( (const __m256i*)source + j );
+			_mm256_storeu_si256( (__m256i*)destination + j, _mm256_xor_si256( value, x[j] ) );
+		}
+		source += 128;
+		destination += 128;
+	}
+	if ( i < blocks ) {
+		aesCtrNI( roundKeys, counter, block + i, source, destination, blocks - i );
+	}
+}
+
+FILEDEEN_TARGET( "avx512f,aes,vaes" ) static void aesCtrVAES512( const unsigned char* roundKeys, const unsigned char* counter, uint64_t block, const char* source, char* destination, size_t blocks ) {
+	__m512i keys[15];
+	for ( int i = 0; i < 15; i++ ) {
+		keys[i] = _mm512_broadcast_i32x4( _mm_loadu_si128( (const __m128i*)(roundKeys + i*16) ) );
+	}
+	long long nonce;
+	memcpy( &nonce, counter, sizeof( nonce ) );
+	uint64_t start = loadBigEndian64( counter + 8 ) + block;
+
+	size_t i = 0;
+	for ( ; i + 16 <= blocks; i += 16 ) {
+		__m512i x[4];
+		for ( int j = 0; j < 4; j++ ) {
+			uint64_t number = start + i + j*4;
+			x[j] = _mm512_xor_si512( _mm512_set_epi64( (long long)byteSwap64( number + 3 ), nonce, (long long)byteSwap64( number + 2 ), nonce,
+				(long long)byteSwap64( number + 1 ), nonce, (long long)byteSwap64( number ), nonce ), keys[0] );
+		}
+		for ( int round = 1; round < 14; round++ ) {
+			for ( int j = 0; j < 4; j++ ) {
+				x[j] = _mm512_aesenc_epi128( x[j], keys[round] );
+			}
+		}
+		for ( int j = 0; j < 4; j++ ) {
+			x[j] = _mm512_aesenclast_epi128( x[j], keys[14] );
+			_mm512_storeu_si512( destination + j*64, _mm512_xor_si512( _mm512_loadu_si512( source + j*64 ), x[j] ) );
+		}
+		source += 256;
+		destination += 256;
+	}
+	if ( i < blocks ) {
+		aesCtrNI( roundKeys, counter, block + i, source, destination, blocks - i );
+	}
+}
+
+static void cpuid( int leaf, int subleaf, unsigned int registers[4] ) {
+#if defined( _MSC_VER )
+	__cpuidex( (int*)registers, leaf, subleaf );
+#else
+	__cpuid_count( leaf, subleaf, registers[0], registers[1], registers[2], registers[3] );
+#endif
+}
+
+//Register state the OS saves on context switch, AVX registers are unusable unless it includes them
+static uint64_t enabledRegisterState() {
+#if defined( _MSC_VER )
+	return _xgetbv( 0 );
+#else
+	unsigned int low, high;
+	__asm__ volatile( "xgetbv" : "=a"( low ), "=d"( high ) : "c"( 0 ) );
+	return ((uint64_t)high << 32) | low;
+#endif
+}
+#endif
+
+static CipherKernel detectCipherKernel() {
+#ifdef FILEDEEN_X86
+	unsigned int registers[4];
+	cpuid( 0, 0, registers );
+	unsigned int maxLeaf = registers[0];
+	cpuid( 1, 0, registers );
+	bool sse2 = (registers[3] >> 26) & 1,
+		osxsave = (registers[2] >> 27) & 1;
+	if ( osxsave && maxLeaf >= 7 ) {
+		uint64_t registerState = enabledRegisterState();
+		cpuid( 7, 0, registers );
+		if ( (registerState & 0xE6) == 0xE6 && ((registers[1] >> 16) & 1) ) {
+			return CipherKernel::AVX512;
+		}
+		if ( (registerState & 0x06) == 0x06 && ((registers[1] >> 5) & 1) ) {
+			return CipherKernel::AVX2;
+		}
+	}
+	if ( sse2 ) {
+		return CipherKernel::SSE2;
+	}
+#endif
+	return CipherKernel::Scalar;
+}
+
+//Whether the CPU has AES-NI and VAES, the kernels above only use them once the vector extensions they go with are usable too
+struct AesSupport {
+	bool aesNI, vaes;
+};
+
+static AesSupport detectAesSupport() {
+	AesSupport support = { false, false };
+#ifdef FILEDEEN_X86
+	unsigned int registers[4];
+	cpuid( 0, 0, registers );
+	unsigned int maxLeaf = registers[0];
+	cpuid( 1, 0, registers );
+	support.aesNI = (registers[2] >> 25) & 1;
+	if ( support.aesNI && maxLeaf >= 7 ) {
+		cpuid( 7, 0, registers );
+		support.vaes = (registers[2] >> 9) & 1;
+	}
+#endif
+	return support;
+}
+
+static AesKernel aesKernel( CipherKernel kernel, const char** name = nullptr ) {
+	const char* kernelName = "Scalar";
+	AesKernel function = aesCtrScalar;
+#ifdef FILEDEEN_X86
+	static const AesSupport support = detectAesSupport();
+	if ( kernel >= CipherKernel::AVX512 && support.vaes ) {
+		kernelName = "VAES-512";
+		function = aesCtrVAES512;
+	}
+	else if ( kernel >= CipherKernel::AVX2 && support.vaes ) {
+		kernelName = "VAES-256";
+		function = aesCtrVAES256;
+	}
+	else if ( kernel >= CipherKernel::SSE2 && support.aesNI ) {
+		kernelName = "AES-NI";
+		function = aesCtrNI;
+	}
+#endif
+	if ( name != nullptr ) {
+		*name = kernelName;
+	}
+	return function;
+}
+
+static BlockKernel blockKernel( CipherKernel kernel ) {
+	switch ( kernel ) {
+#ifdef FILEDEEN_X86
+		case CipherKernel::AVX512:
+			return xorBlocksAVX512;
+		case CipherKernel::AVX2:
+			return xorBlocksAVX2;
+		case CipherKernel::SSE2:
+			return xorBlocksSSE2;
+#endif
+		default:
+			return xorBlocksScalar;
+	}
+}
+
+static std::atomic<CipherKernel> activeCipherKernel( supportedCipherKernel() );
+static std::atomic<BlockKernel> activeBlockKernel( blockKernel( activeCipherKernel ) );
+static std::atomic<AesKernel> activeAesKernel( aesKernel( activeCipherKernel ) );
+
+CipherKernel FileDeen::supportedCipherKernel() {
+	static const CipherKernel kernel = detectCipherKernel();
+	return kernel;
+}
+
+CipherKernel FileDeen::cipherKernel() {
+	return activeCipherKernel;
+}
+
+bool FileDeen::setCipherKernel( CipherKernel kernel ) {
+	if ( kernel > supportedCipherKernel() ) {
+		return false;
+	}
+	activeCipherKernel = kernel;
+	activeBlockKernel = blockKernel( kernel );
+	activeAesKernel = aesKernel( kernel );
+	return true;
+}
+
+const char* FileDeen::cipherKernelName( CipherKernel kernel ) {
+	switch ( kernel ) {
+		case CipherKernel::AVX512:
+			return "AVX-512";
+		case CipherKernel::AVX2:
+			return "AVX2";
+		case CipherKernel::SSE2:
+			return "SSE2";
+		default:
+			return "Scalar";
+	}
+}
+
+const char* FileDeen::aesKernelName( CipherKernel kernel ) {
+	const char* name;
+	aesKernel( kernel, &name );
+	return name;
+}
+
+void FileDeen::applyBlockMasks( char* data, size_t length, size_t position, const char* masks ) {
+	applyBlockMasks( data, data, length, position, masks );
+}
+
+void FileDeen::applyBlockMasks( const char* source, char* destination, size_t length, size_t position, const char* masks ) {
+	BlockKernel kernel = activeBlockKernel.load( std::memory_order_relaxed );
+	if ( kernel == nullptr ) {  //Called during static initialization, before activeBlockKernel is set up
+		kernel = blockKernel( supportedCipherKernel() );
+	}
+
+	//Bytes before the next block boundary
+	size_t offset = position % blockMaskSize;
+	while ( length > 0 && offset % blockSize != 0 ) {
+		*destination++ = *source++ ^ masks[offset];
+		offset = (offset + 1) % blockMaskSize;
+		length--;
+	}
+
+	size_t blocks = length / blockSize;
+	if ( blocks > 0 ) {
+		kernel( source, destination, blocks, offset != 0, masks );
+		source += blocks*blockSize;
+		destination += blocks*blockSize;
+		length -= blocks*blockSize;
+		offset = (offset + blocks*blockSize) % blockMaskSize;
+	}
+
+	//Partial block at the end
+	for ( size_t i = 0; i < length; i++ ) {
+		destination[i] = source[i] ^ masks[offset + i];
+	}
+}
+
+
+//Whole counter blocks go straight through the kernel, a block cut off by either end of the range is encrypted into a buffer first
+static void applyAesCtr( const char* state, const char* source, char* destination, size_t length, uint64_t position ) {
+	AesKernel kernel = activeAesKernel.load( std::memory_order_relaxed );
+	if ( kernel == nullptr ) {
+		kernel = aesKernel( supportedCipherKernel() );
+	}
+	const unsigned char* roundKeys = (const unsigned char*)state;
+	const unsigned char* counter = roundKeys + aesRoundKeysSize;
+	uint64_t block = position / aesBlockSize;
+	size_t offset = (size_t)(position % aesBlockSize);
+	while ( length > 0 ) {
+		size_t blocks = offset == 0 ? length / aesBlockSize : 0;
+		if ( blocks > 0 ) {
+			kernel( roundKeys, counter, block, source, destination, blocks );
+			block += blocks;
+			source += blocks*aesBlockSize;
+			destination += blocks*aesBlockSize;
+			length -= blocks*aesBlockSize;
+			continue;
+		}
+		char keystream[aesBlockSize] = {};
+		kernel( roundKeys, counter, block, keystream, keystream, 1 );
+		size_t partLength = std::min( length, (size_t)aesBlockSize - offset );
+		for ( size_t i = 0; i < partLength; i++ ) {
+			destination[i] = source[i] ^ keystream[offset+i];
+		}
+		block++;
+		offset = 0;
+		source += partLength;
+		destination += partLength;
+		length -= partLength;
+	}
+}
+
+namespace {
+	class BlockMaskBackend : public CipherBackend {
+	public:
+		void setup( const KeyContext& key, const char* initVector, char* state ) const override {
+			key.buildBlockMasks( initVector, state );
+		}
+
+		void apply( const char* state, const char* source, char* destination, size_t length, uint64_t position ) const override {
+			applyBlockMasks( source, destination, length, (size_t)(position % blockMaskSize), state );
+		}
+
+		const char* name() const override {
+			return "v5";
+		}
+	};
+
+	class AesCtrBackend : public CipherBackend {
+	public:
+		void setup( const KeyContext& key, const char* initVector, char* state ) const override {
+			memcpy( state, key.aesRoundKeys(), aesRoundKeysSize );
+			memcpy( state + aesRoundKeysSize, initVector, aesBlockSize );
+		}
+
+		void apply( const char* state, const char* source, char* destination, size_t length, uint64_t position ) const override {
+			applyAesCtr( state, source, destination, length, position );
+		}
+
+		const char* name() const override {
+			return "AES-256-CTR";
+		}
+	};
+}
+
+const CipherBackend& FileDeen::cipherBackend( CipherScheme scheme ) {
+	static BlockMaskBackend blockMasks;
+	static AesCtrBackend aesCtr;
+	if ( scheme == CipherScheme::AESCTR ) {
+		return aesCtr;
+	}
+	return blockMasks;
+}
@@ -0,0 +1,271 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include "compressor.h"
+using namespace FileDeen;
+
+//Block format is a list of sequences, each a run of literals followed by a match against earlier output
+//A sequence starts with a token holding the literal length in its high nibble and the match length in its low one,
+//either nibble at 15 is continued in following bytes, each adding up to 255
+//The match offset follows the literals as a uint16, the last sequence has literals only
+const int hashBits = 14,
+	minimumMatch = 4,
+	maximumOffset = 0xFFFF;
+
+//Entries whose sample is closer to random than this are stored uncompressed, in bits per byte
+const double maximumEntropy = 7.5;
+const size_t minimumCompressibleLength = 256;
+
+static uint32_t readUint32( const unsigned char* data ) {
+	uint32_t value;
+	memcpy( &value, data, sizeof( value ) );
+	return value;
+}
+
+static uint32_t hashSequence( uint32_t sequence ) {
+	return (sequence * 2654435761u) >> (32-hashBits);
+}
+
+bool FileDeen::isCompressible( const char* sample, size_t length ) {
+	if ( length < minimumCompressibleLength ) {
+		return false;
+	}
+	size_t counts[256] = {};
+	for ( size_t i = 0; i < length; i++ ) {
+		counts[(unsigned char)sample[i]]++;
+	}
+	double entropy = 0;
+	for ( size_t count : counts ) {
+		if ( count > 0 ) {
+			double probability = (double)count / length;
+			entropy -= probability * std::log2( probability );
+		}
+	}
+	return entropy < maximumEntropy;
+}
+
+size_t FileDeen::compressBound( size_t length ) {
+	return length + length/255 + 16;
+}
+
+static unsigned char* writeLength( unsigned char* output, size_t length ) {
+	while ( length >= 255 ) {
+		*output++ = 255;
+		length -= 255;
+	}
+	*output++ = (unsigned char)length;
+	return output;
+}
+
+static unsigned char* writeSequence( unsigned char* output, const unsigned char* literals, size_t literalLength, size_t offset, size_t matchLength ) {
+	unsigned char* token = output++;
+	*token = (unsigned char)(std::min<size_t>( literalLength, 15 ) << 4);
+	if ( literalLength >= 15 ) {
+		output = writeLength( output, literalLength-15 );
+	}
+	memcpy( output, literals, literalLength );
+	output += literalLength;
+
+	if ( matchLength > 0 ) {
+		output[0] = (unsigned char)(offset & 0xFF);
+		output[1] = (unsigned char)(offset >> 8);
+		output += 2;
+		size_t extraLength = matchLength - minimumMatch;
+		*token |= (unsigned char)std::min<size_t>( extraLength, 15 );
+		if ( extraLength >= 15 ) {
+			output = writeLength( output, extraLength-15 );
+		}
+	}
+	return output;
+}
+
+//Greedy matching against the last position each 4 byte sequence was seen at, table is cleared and may be reused between blocks
+static size_t compressBlockWith( const char* source, size_t length, char* destination, std::vector<uint32_t>& table ) {
+	const unsigned char* input = (const unsigned char*)source;
+	unsigned char* output = (unsigned char*)destination;
+	table.assign( (size_t)1 << hashBits, 0 );
+
+	size_t position = 0, anchor = 0;
+	while ( position + minimumMatch <= length ) {
+		uint32_t sequence = readUint32( input+position );
+		uint32_t& lastSeen = table[hashSequence( sequence )];
+		size_t candidate = lastSeen;
+		lastSeen = (uint32_t)position + 1;
+
+		if ( candidate > 0 && position - (candidate-1) <= maximumOffset && readUint32( input+candidate-1 ) == sequence ) {
+			size_t match = candidate-1, matchLength = minimumMatch;
+			while ( position + matchLength < length && input[match+matchLength] == input[position+matchLength] ) {
+				matchLength++;
+			}
+			output = writeSequence( output, input+anchor, position-anchor, position-match, matchLength );
+			position += matchLength;
+			anchor = position;
+		}
+		else {
+			//Step faster through data that keeps failing to match
+			position += 1 + ((position-anchor) >> 6);
+		}
+	}
+	output = writeSequence( output, input+anchor, length-anchor, 0, 0 );
+	return output - (unsigned char*)destination;
+}
+
+size_t FileDeen::compressBlock( const char* source, size_t length, char* destination ) {
+	std::vector<uint32_t> table;
+	return compressBlockWith( source, length, destination, table );
+}
+
+static bool readLength( const unsigned char*& input, const unsigned char* inputEnd, size_t& length ) {
+	unsigned char byte;
+	do {
+		if ( input >= inputEnd ) {
+			return false;
+		}
+		byte = *input++;
+		length += byte;
+	} while ( byte == 255 );
+	return true;
+}
+
+bool FileDeen::decompressBlock( const char* source, size_t length, char* destination, size_t originalLength ) {
+	const unsigned char* input = (const unsigned char*)source;
+	const unsigned char* inputEnd = input + length;
+	unsigned char* outputStart = (unsigned char*)destination;
+	unsigned char* output = outputStart;
+	unsigned char* outputEnd = outputStart + originalLength;
+
+	while ( input < inputEnd ) {
+		unsigned char token = *input++;
+		size_t literalLength = token >> 4;
+		if ( literalLength == 15 && !readLength( input, inputEnd, literalLength ) ) {
+			return false;
+		}
+		if ( literalLength > (size_t)(inputEnd-input) || literalLength > (size_t)(outputEnd-output) ) {
+			return false;
+		}
+		memcpy( output, input, literalLength );
+		input += literalLength;
+		output += literalLength;
+		if ( input == inputEnd ) {
+			break;
+		}
+
+		if ( inputEnd-input < 2 ) {
+			return false;
+		}
+		size_t offset = input[0] | (input[1] << 8);
+		input += 2;
+		size_t matchLength = token & 0x0F;
+		if ( matchLength == 15 && !readLength( input, inputEnd, matchLength ) ) {
+			return false;
+		}
+		matchLength += minimumMatch;
+		if ( offset == 0 || offset > (size_t)(output-outputStart) || matchLength > (size_t)(outputEnd-output) ) {
+			return false;
+		}
+
+		//Matches may overlap the bytes they produce, so short offsets are copied one byte at a time
+		const unsigned char* match = output - offset;
+		if ( offset >= matchLength ) {
+			memcpy( output, match, matchLength );
+		}
+		else {
+			for ( size_t i = 0; i < matchLength; i++ ) {
+				output[i] = match[i];
+			}
+		}
+		output += matchLength;
+	}
+	return output == outputEnd;
+}
+
+
+
+BlockCompressor::BlockCompressor() : _block( compressionBlockSize ), _blockLength( 0 ) {
+}
+
+void BlockCompressor::update( const char* data, size_t length, std::vector<char>& output ) {
+	while ( length > 0 ) {
+		size_t copyLength = std::min( length, compressionBlockSize - _blockLength );
+		memcpy( &_block[_blockLength], data, copyLength );
+		_blockLength += copyLength;
+		data += copyLength;
+		length -= copyLength;
+		if ( _blockLength == compressionBlockSize ) {
+			this->compress( output );
+		}
+	}
+}
+
+void BlockCompressor::finish( std::vector<char>& output ) {
+	if ( _blockLength > 0 ) {
+		this->compress( output );
+	}
+}
+
+void BlockCompressor::compress( std::vector<char>& output ) {
+	size_t headerPosition = output.size();
+	output.resize( headerPosition + compressionBlockHeaderSize + compressBound( _blockLength ) );
+	char* stored = &output[headerPosition + compressionBlockHeaderSize];
+	uint32_t originalLength = (uint32_t)_blockLength;
+	uint32_t storedLength = (uint32_t)compressBlockWith( &_block[0], _blockLength, stored, _table );
+	if ( storedLength >= originalLength ) {
+		memcpy( stored, &_block[0], _blockLength );
+		storedLength = originalLength;
+	}
+	memcpy( &output[headerPosition], &originalLength, sizeof( originalLength ) );
+	memcpy( &output[headerPosition + sizeof( originalLength )], &storedLength, sizeof( storedLength ) );
+	output.resize( headerPosition + compressionBlockHeaderSize + storedLength );
+	_blockLength = 0;
+}
+
+
+
+BlockDecompressor::BlockDecompressor() : _totalLength( 0 ) {
+}
+
+int BlockDecompressor::update( const char* data, size_t length, const std::function<void( const char*, size_t )>& output ) {
+	_input.insert( _input.end(), data, data + length );
+
+	size_t position = 0;
+	while ( _input.size() - position >= (size_t)compressionBlockHeaderSize ) {
+		uint32_t originalLength, storedLength;
+		memcpy( &originalLength, &_input[position], sizeof( originalLength ) );
+		memcpy( &storedLength, &_input[position + sizeof( originalLength )], sizeof( storedLength ) );
+		if ( originalLength == 0 || originalLength > compressionBlockSize || storedLength > originalLength ) {
+			printf( "Error: Compressed data is corrupt\n" );
+			return 1;
+		}
+		if ( _input.size() - position - compressionBlockHeaderSize < storedLength ) {
+			break;
+		}
+
+		const char* stored = &_input[position + compressionBlockHeaderSize];
+		if ( storedLength == originalLength ) {
+			output( stored, originalLength );
+		}
+		else {
+			if ( _block.empty() ) {
+				_block.resize( compressionBlockSize );
+			}
+			if ( !decompressBlock( stored, storedLength, &_block[0], originalLength ) ) {
+				printf( "Error: Compressed data is corrupt\n" );
+				return 1;
+			}
+			output( &_block[0], originalLength );
+		}
+		_totalLength += originalLength;
+		position += compressionBlockHeaderSize + storedLength;
+	}
+	_input.erase( _input.begin(), _input.begin() + position );
+	return 0;
+}
+
+int BlockDecompressor::finish() {
+	if ( !_input.empty() ) {
+		printf( "Error: Compressed data ends partway through a block\n" );
+		return 1;
+	}
+	return 0;
+}
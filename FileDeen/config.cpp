@@ -1,21 +1,44 @@
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
+#include <limits>
 #include "config.h"
 using namespace FileDeen;
 
+//The config file lives next to the executable rather than in the working directory
+static std::filesystem::path executablePath() {
+#ifdef _WIN32
+	wchar_t* buffer;
+	_get_wpgmptr( &buffer );
+	return buffer;
+#else
+	std::error_code error;
+	std::filesystem::path path = std::filesystem::read_symlink( "/proc/self/exe", error );
+	return error ? std::filesystem::current_path() / "FileDeen" : path;
+#endif
+}
+
 Config::Config( std::wstring fileName ) {
 	_stringOptions = {
 		{"sKey",""}
 	};
 	_boolOptions = {
+		{"bCompress",false},
+		{"bDeduplicate",true},
 		{"bKeyEnabled",false},
 		{"bKeyUncensored",false},
 		{"bOnlyIncludeFolderContents",false},
 		{"bUseRealNames",false},
 		{"bVerboseLogging",false}
 	};
-	wchar_t* buffer;
-	_get_wpgmptr( &buffer );
-	_filePath = std::filesystem::path( buffer ).parent_path().wstring() + L"\\" + fileName;
+	_intOptions = {
+		{"iDirectWriteMB",0},
+		{"iSolidThresholdKB",0},
+		{"iStreamBufferSizeKB",4096},
+		{"iThreadCount",0},
+		{"iVolumeSizeMB",0}
+	};
+	_filePath = executablePath().parent_path() / fileName;
 	if ( !std::filesystem::exists( _filePath ) ) {
 		this->write();
 	}
@@ -40,6 +63,15 @@ bool Config::getBool( std::string key ) {
 	}
 }
 
+int Config::getInt( std::string key ) {
+	if ( _intOptions.find( key ) != _intOptions.end() ) {
+		return _intOptions[key];
+	}
+	else {
+		return 0;
+	}
+}
+
 void Config::read() {
 	std::string buffer( 256, 0x00 );
 	std::fstream configFile( _filePath, std::ios::in );
@@ -66,6 +98,18 @@ void Config::read() {
 					break;
 			}
 		}
+		else if ( _intOptions.find( subBuffer ) != _intOptions.end() ) {
+			configFile.get( &buffer[0], buffer.size(), '\n' );
+			char* end;
+			long value = strtol( buffer.c_str(), &end, 10 );
+			//Same bounds as the command line takes, a negative count or size would wrap around once it's used unsigned
+			if ( end != buffer.c_str() && value >= 0 && value <= 1024*1024 ) {
+				_intOptions[subBuffer] = value;
+			}
+			else {
+				printf( "Invalid value for %s: \'%s\'\n", subBuffer.c_str(), buffer.c_str() );
+			}
+		}
 		else {
 			if ( strlen( &buffer[0] ) > 0 ) {
 				printf( "Invalid key: \'%s\'\n", buffer.c_str() );
@@ -86,5 +130,9 @@ void Config::write() {
 		std::string line = pair.first + '=' + std::to_string( pair.second ) + '\n';
 		configFile.write( line.c_str(), line.size() );
 	}
+	for ( const auto& pair : _intOptions ) {
+		std::string line = pair.first + '=' + std::to_string( pair.second ) + '\n';
+		configFile.write( line.c_str(), line.size() );
+	}
 	configFile.close();
 }
\ No newline at end of file
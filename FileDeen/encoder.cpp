@@ -0,0 +1,730 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include "checksum.h"
+#include "compressor.h"
+#include "encoder.h"
+#include "metrics.h"
+using namespace FileDeen;
+
+ParallelEncoder::ParallelEncoder( unsigned int threadCount, size_t bufferSize ) {
+	if ( threadCount == 0 ) {
+		threadCount = std::max( std::thread::hardware_concurrency(), 1u );
+	}
+	_threadCount = threadCount;
+	_bufferSize = bufferSize > 0 ? bufferSize : defaultStreamBufferSize;
+	_memoryBudget = _bufferSize*_threadCount*2;
+	_compress = false;
+	_solidThreshold = 0;
+	_jobs = nullptr;
+	_key = nullptr;
+	_firstIndex = 0;
+	_initVectorSeed = 0;
+	_nextUnit = _head = _bufferedBytes = 0;
+}
+
+void ParallelEncoder::ChunkQueue::pop_front() {
+	_first++;
+	if ( _first == _chunks.size() ) {
+		_chunks.clear();
+		_first = 0;
+	}
+}
+
+//Chunks already taken out are dropped from the front before the storage would have to grow
+void ParallelEncoder::ChunkQueue::push_back( std::vector<char>&& chunk ) {
+	if ( _chunks.size() == _chunks.capacity() && _first > 0 ) {
+		_chunks.erase( _chunks.begin(), _chunks.begin() + _first );
+		_first = 0;
+	}
+	_chunks.push_back( std::move( chunk ) );
+}
+
+int FileDeen::scanFiles( const std::vector<std::filesystem::path>& paths, bool onlyFolderContents, unsigned int threadCount, std::vector<EncodeJob>& jobs ) {
+	PhaseTimer timer( Phase::Scan );
+	if ( threadCount == 0 ) {
+		threadCount = std::max( std::thread::hardware_concurrency(), 1u );
+	}
+	jobs.clear();
+	int result = 0;
+	for ( const auto& givenPath : paths ) {
+		//Relative paths, and paths ending in a separator, have no name to store entries under
+		std::filesystem::path rootPath = std::filesystem::absolute( givenPath ).lexically_normal();
+		if ( !rootPath.has_filename() && rootPath.has_parent_path() ) {
+			rootPath = rootPath.parent_path();
+		}
+		std::error_code error;
+		std::filesystem::directory_entry root( rootPath, error );
+		if ( !error && root.is_regular_file( error ) ) {
+			jobs.push_back( { rootPath, rootPath.filename(), root.file_size( error ) } );
+			continue;
+		}
+		if ( error || !root.is_directory( error ) ) {
+			printf( "Error: \'%s\' does not exist or is unsupported\n", givenPath.u8string().c_str() );
+			result = 1;
+			continue;
+		}
+
+		//Each folder is read by whichever thread takes it off the queue, relative paths are built up on the way down
+		struct Folder {
+			std::filesystem::path path, relativePath;
+		};
+		std::deque<Folder> folders = { { rootPath, onlyFolderContents ? std::filesystem::path() : rootPath.filename() } };
+		std::vector<EncodeJob> found;
+		unsigned int busyThreads = 0;
+		std::mutex mutex;
+		std::condition_variable condition;
+		auto scanFolders = [&]() {
+			std::unique_lock<std::mutex> lock( mutex );
+			while ( true ) {
+				condition.wait( lock, [&] { return !folders.empty() || busyThreads == 0; } );
+				if ( folders.empty() ) {
+					return;
+				}
+				Folder folder = std::move( folders.front() );
+				folders.pop_front();
+				busyThreads++;
+				lock.unlock();
+
+				std::vector<Folder> subfolders;
+				std::vector<EncodeJob> files;
+				std::error_code error;
+				for ( std::filesystem::directory_iterator it( folder.path, error ), end; !error && it != end; it.increment( error ) ) {
+					const auto& dirEntry = *it;
+					std::error_code entryError;
+					//Linked folders aren't followed, like recursive_directory_iterator doesn't by default
+					if ( dirEntry.is_directory( entryError ) && !dirEntry.is_symlink( entryError ) ) {
+						subfolders.push_back( { dirEntry.path(), folder.relativePath / dirEntry.path().filename() } );
+					}
+					else if ( dirEntry.is_regular_file( entryError ) ) {
+						uint64_t fileSize = dirEntry.file_size( entryError );
+						files.push_back( { dirEntry.path(), folder.relativePath / dirEntry.path().filename(), entryError ? 0 : fileSize } );
+					}
+				}
+				if ( error ) {
+					printf( "Error: Could not read folder \'%s\'\n", folder.path.u8string().c_str() );
+				}
+
+				lock.lock();
+				result |= error ? 1 : 0;
+				busyThreads--;
+				std::move( subfolders.begin(), subfolders.end(), std::back_inserter( folders ) );
+				std::move( files.begin(), files.end(), std::back_inserter( found ) );
+				condition.notify_all();
+			}
+		};
+		std::vector<std::thread> workers;
+		for ( unsigned int i = 1; i < threadCount; i++ ) {
+			workers.emplace_back( scanFolders );
+		}
+		scanFolders();
+		for ( auto& thread : workers ) {
+			thread.join();
+		}
+
+		//Threads finish folders in any order, sorting keeps archives of the same files identical
+		std::sort( found.begin(), found.end(), []( const EncodeJob& a, const EncodeJob& b ) { return a.relativePath < b.relativePath; } );
+		std::move( found.begin(), found.end(), std::back_inserter( jobs ) );
+	}
+	return result;
+}
+
+static bool hashFile( const std::filesystem::path& fileName, std::vector<char>& buffer, uint64_t& hash ) {
+	std::fstream inputFile( fileName, std::ios::in | std::ios::binary );
+	if ( !inputFile ) {
+		return false;
+	}
+	//64 bit multiply and xorshift over whole words, the tail of the file is zero padded
+	//Buffer has room for one word more than is read into it at once
+	hash = 0x46654432446564ull;
+	do {
+		inputFile.read( &buffer[0], buffer.size() - sizeof( uint64_t ) );
+		size_t length = (size_t)inputFile.gcount();
+		size_t wordsLength = (length + sizeof( uint64_t )-1) & ~(sizeof( uint64_t )-1);
+		std::fill( buffer.begin() + length, buffer.begin() + wordsLength, 0 );
+		for ( size_t i = 0; i < wordsLength; i += sizeof( uint64_t ) ) {
+			uint64_t word;
+			memcpy( &word, &buffer[i], sizeof( word ) );
+			hash = (hash ^ word) * 0x9E3779B97F4A7C15ull;
+			hash ^= hash >> 29;
+		}
+	} while ( inputFile );
+	return !inputFile.bad();
+}
+
+static bool sameContents( const std::filesystem::path& fileNameA, const std::filesystem::path& fileNameB, std::vector<char>& bufferA, std::vector<char>& bufferB ) {
+	std::fstream inputFileA( fileNameA, std::ios::in | std::ios::binary ), inputFileB( fileNameB, std::ios::in | std::ios::binary );
+	if ( !inputFileA || !inputFileB ) {
+		return false;
+	}
+	do {
+		inputFileA.read( &bufferA[0], bufferA.size() );
+		inputFileB.read( &bufferB[0], bufferB.size() );
+		if ( inputFileA.gcount() != inputFileB.gcount() || memcmp( &bufferA[0], &bufferB[0], (size_t)inputFileA.gcount() ) != 0 ) {
+			return false;
+		}
+	} while ( inputFileA && inputFileB );
+	return true;
+}
+
+size_t ParallelEncoder::findDuplicates( std::vector<EncodeJob>& jobs ) {
+	//Group by size first, a file with a size of its own can't have a duplicate
+	std::unordered_map<uint64_t, std::vector<size_t>> sizeGroups;
+	for ( size_t i = 0; i < jobs.size(); i++ ) {
+		jobs[i].duplicateOf = noDuplicate;
+		if ( jobs[i].size > 0 ) {
+			sizeGroups[jobs[i].size].push_back( i );
+		}
+	}
+	std::vector<size_t> candidates;
+	for ( const auto& group : sizeGroups ) {
+		if ( group.second.size() > 1 ) {
+			candidates.insert( candidates.end(), group.second.begin(), group.second.end() );
+		}
+	}
+	if ( candidates.empty() ) {
+		return 0;
+	}
+
+	//Hash the candidates on every thread, files that can't be read are left to fail when they're encoded
+	std::vector<uint64_t> hashes( candidates.size() );
+	std::vector<char> hashed( candidates.size(), false );
+	std::atomic<size_t> nextCandidate( 0 );
+	auto hashCandidates = [&]() {
+		std::vector<char> buffer( _bufferSize + sizeof( uint64_t ) );
+		for ( size_t i = nextCandidate++; i < candidates.size(); i = nextCandidate++ ) {
+			hashed[i] = hashFile( jobs[candidates[i]].sourceFile, buffer, hashes[i] );
+		}
+	};
+	std::vector<std::thread> workers;
+	for ( unsigned int i = 1; i < std::min<size_t>( _threadCount, candidates.size() ); i++ ) {
+		workers.emplace_back( hashCandidates );
+	}
+	hashCandidates();
+	for ( auto& thread : workers ) {
+		thread.join();
+	}
+
+	//The first job with given contents is stored, every later one refers to it
+	//Jobs sharing a size and hash whose contents differ, from a collision or a file changed since it was hashed, are each first copies of their own
+	std::map<std::pair<uint64_t, uint64_t>, std::vector<size_t>> firstCopies;
+	std::vector<char> bufferA( _bufferSize ), bufferB( _bufferSize );
+	std::vector<size_t> order( candidates.size() );
+	for ( size_t i = 0; i < order.size(); i++ ) {
+		order[i] = i;
+	}
+	std::sort( order.begin(), order.end(), [&]( size_t a, size_t b ) { return candidates[a] < candidates[b]; } );
+	size_t duplicates = 0;
+	for ( size_t i : order ) {
+		if ( !hashed[i] ) {
+			continue;
+		}
+		size_t job = candidates[i];
+		std::vector<size_t>& copies = firstCopies[std::make_pair( jobs[job].size, hashes[i] )];
+		auto found = std::find_if( copies.begin(), copies.end(), [&]( size_t first ) {
+			return sameContents( jobs[first].sourceFile, jobs[job].sourceFile, bufferA, bufferB );
+		} );
+		if ( found != copies.end() ) {
+			jobs[job].duplicateOf = *found;
+			duplicates++;
+		}
+		else {
+			copies.push_back( job );
+		}
+	}
+	return duplicates;
+}
+
+int ParallelEncoder::encode( const std::vector<EncodeJob>& jobs, FeD_Writer& writer, const KeyContext& key, bool verboseLogging ) {
+	_jobs = &jobs;
+	_key = &key;
+	_firstIndex = writer.nextIndex();
+	std::random_device random;
+	_initVectorSeed = ((uint64_t)random() << 32 | random()) ^ (uint64_t)time( NULL );
+	this->planUnits();
+	_slots = std::vector<Slot>( _threadCount*2 );
+	_jobStates.assign( jobs.size(), JobState::Pending );
+	_nextUnit = _head = _bufferedBytes = 0;
+
+	std::vector<std::thread> workers;
+	for ( unsigned int i = 0; i < _threadCount; i++ ) {
+		workers.emplace_back( &ParallelEncoder::worker, this );
+	}
+
+	//Commit entries strictly in index order, each one as soon as its worker has data ready
+	int result = 0;
+	for ( size_t i = 0; i < _units.size(); i++ ) {
+		Slot& slot = _slots[i % _slots.size()];
+		std::unique_lock<std::mutex> lock( _mutex );
+		_condition.wait( lock, [&] { return slot.opened || slot.finished; } );
+
+		if ( !slot.failed ) {
+			lock.unlock();
+			if ( verboseLogging ) {
+				if ( _units[i].size() > 1 ) {
+					printf( "Solid block of %zu files: Writing entry...", _units[i].size() );
+				}
+				else {
+					printf( "%s: Writing entry...", jobs[_units[i][0]].relativePath.u8string().c_str() );
+				}
+			}
+			writer.writeHeader( *slot.entry );
+			lock.lock();
+			while ( true ) {
+				_condition.wait( lock, [&] { return !slot.chunks.empty() || slot.finished; } );
+				if ( slot.chunks.empty() ) {
+					break;
+				}
+				std::vector<char> chunk = std::move( slot.chunks.front() );
+				slot.chunks.pop_front();
+				lock.unlock();
+				writer.writeData( &chunk[0], chunk.size() );
+				lock.lock();
+				_bufferedBytes -= chunk.size();
+				_freeBuffers.push_back( std::move( chunk ) );
+				_condition.notify_all();
+			}
+			//Padding and checksum go after the data, so nothing written has to be gone back to
+			writer.finishEntry( slot.dataPadLength, slot.checksum );
+			if ( verboseLogging ) printf( "Done!\n" );
+			for ( size_t n = 0; n < _units[i].size(); n++ ) {
+				countEntry();
+			}
+		}
+		if ( slot.failed || slot.incomplete ) {
+			result = 1;
+		}
+		for ( size_t job : _units[i] ) {
+			_jobStates[job] = slot.failed || slot.incomplete ? JobState::Failed : JobState::Stored;
+		}
+		//Anything a failed entry buffered is let go of, so none of it ends up in the entry using the slot next
+		while ( !slot.chunks.empty() ) {
+			_bufferedBytes -= slot.chunks.front().size();
+			_freeBuffers.push_back( std::move( slot.chunks.front() ) );
+			slot.chunks.pop_front();
+		}
+
+		if ( slot.entry ) {
+			_freeEntries.push_back( std::move( slot.entry ) );
+		}
+		slot.opened = slot.finished = slot.failed = slot.incomplete = false;
+		_head++;
+		_condition.notify_all();
+	}
+
+	for ( auto& thread : workers ) {
+		thread.join();
+	}
+	_freeBuffers.clear();
+	_freeEntries.clear();
+	_units.clear();
+	_jobStates.clear();
+	_jobs = nullptr;
+	_key = nullptr;
+	return result;
+}
+
+//Groups jobs into the units committed as entries, a solid block takes the place of its first member
+//Blocks are filled in job order, each is closed once the next file would take it past the block size or member limit
+void ParallelEncoder::planUnits() {
+	const std::vector<EncodeJob>& jobs = *_jobs;
+	std::vector<bool> duplicated( jobs.size(), false );
+	for ( const auto& job : jobs ) {
+		if ( job.duplicateOf != noDuplicate ) {
+			duplicated[job.duplicateOf] = true;
+		}
+	}
+
+	_units.clear();
+	size_t block = SIZE_MAX;
+	uint64_t blockLength = 0;
+	for ( size_t i = 0; i < jobs.size(); i++ ) {
+		const EncodeJob& job = jobs[i];
+		if ( _solidThreshold == 0 || job.size > _solidThreshold || job.duplicateOf != noDuplicate || duplicated[i] ) {
+			_units.push_back( { i } );
+			continue;
+		}
+		if ( block == SIZE_MAX || blockLength + job.size > solidBlockSize || _units[block].size() >= solidBlockMembers ) {
+			block = _units.size();
+			blockLength = 0;
+			_units.emplace_back();
+		}
+		_units[block].push_back( i );
+		blockLength += job.size;
+	}
+}
+
+//Each worker reads its files through one async reader, so the next part of a file is read while the current one is encrypted
+void ParallelEncoder::worker() {
+	AsyncFileReader inputFile;
+	std::unique_lock<std::mutex> lock( _mutex );
+	while ( true ) {
+		//Stay within a window of slots ahead of the writer, so finished entries never pile up in memory
+		_condition.wait( lock, [&] { return _nextUnit >= _units.size() || _nextUnit < _head + _slots.size(); } );
+		if ( _nextUnit >= _units.size() ) {
+			return;
+		}
+		size_t unit = _nextUnit++;
+		lock.unlock();
+		Slot& slot = _slots[unit % _slots.size()];
+		if ( _units[unit].size() > 1 ) {
+			this->encodeSolidBlock( unit, slot, inputFile );
+		}
+		else {
+			this->encodeJob( unit, _units[unit][0], slot, inputFile );
+		}
+		lock.lock();
+	}
+}
+
+std::unique_ptr<FeD_Entry> ParallelEncoder::newEntry( unsigned int index ) {
+	std::unique_ptr<FeD_Entry> entry;
+	{
+		std::lock_guard<std::mutex> lock( _mutex );
+		if ( !_freeEntries.empty() ) {
+			entry = std::move( _freeEntries.back() );
+			_freeEntries.pop_back();
+		}
+	}
+	if ( entry ) {
+		entry->clear();
+	}
+	else {
+		entry.reset( new FeD_Entry() );
+	}
+	//Mixing in the index keeps entries of the same archive from sharing a vector
+	entry->regenerateInitVector( _initVectorSeed ^ index );
+	entry->setIndex( index );
+	return entry;
+}
+
+std::vector<char> ParallelEncoder::newBuffer() {
+	std::vector<char> buffer;
+	{
+		std::lock_guard<std::mutex> lock( _mutex );
+		if ( !_freeBuffers.empty() ) {
+			buffer = std::move( _freeBuffers.back() );
+			_freeBuffers.pop_back();
+		}
+	}
+	buffer.clear();
+	return buffer;
+}
+
+void ParallelEncoder::encodeJob( size_t unit, size_t index, Slot& slot, AsyncFileReader& inputFile ) {
+	const EncodeJob& job = (*_jobs)[index];
+	std::unique_ptr<FeD_Entry> entry = this->newEntry( _firstIndex + (unsigned int)index );
+
+	std::string sRelativePath = encodePath( job.relativePath );
+	entry->setPathPadLength( encryptPath( sRelativePath, *_key, entry->initVector() ) );
+	entry->setPath( &sRelativePath[0], sRelativePath.length() );
+	//Readers refuse headers with longer paths, and can't find the entries after one either
+	if ( sRelativePath.length() > pathMaxSize ) {
+		printf( "Error: Path of \'%s\' is too long to be stored\n", job.sourceFile.u8string().c_str() );
+		std::lock_guard<std::mutex> lock( _mutex );
+		slot.failed = slot.finished = true;
+		_condition.notify_all();
+		return;
+	}
+
+	//A copy of a file that couldn't be read whole, or changed while being read, has to hold its own data
+	if ( job.duplicateOf != noDuplicate && this->waitForJob( job.duplicateOf ) ) {
+		this->encodeReference( index, slot, std::move( entry ) );
+		return;
+	}
+
+	if ( !inputFile.open( job.sourceFile ) ) {
+		printf( "Error: Could not open \'%s\'\n", job.sourceFile.u8string().c_str() );
+		std::lock_guard<std::mutex> lock( _mutex );
+		slot.failed = slot.finished = true;
+		_condition.notify_all();
+		return;
+	}
+	size_t length = (size_t)inputFile.size();
+
+	if ( _compress ) {
+		std::vector<char> sample( std::min( { length, compressionProbeSize, _bufferSize } ) );
+		if ( inputFile.peek( sample.data(), sample.size() ) == sample.size() && isCompressible( sample.data(), sample.size() ) ) {
+			this->encodeCompressedJob( unit, index, slot, std::move( entry ), inputFile, length );
+			return;
+		}
+	}
+
+	unsigned short paddingLength = CBCEncryptStream::paddingLength( length );
+	size_t totalLength = length + paddingLength;
+	entry->setDataPadLength( paddingLength );
+	entry->setDataLength( totalLength );
+	CBCEncryptStream cipher( *_key, entry->initVector() );
+	{
+		std::lock_guard<std::mutex> lock( _mutex );
+		slot.entry = std::move( entry );
+		slot.opened = true;
+		_condition.notify_all();
+	}
+
+	bool shortRead = false;
+	uint32_t checksum = 0;
+	size_t position = 0;
+	while ( position < totalLength ) {
+		size_t chunkLength = std::min( totalLength - position, _bufferSize );
+		std::vector<char> chunk;
+		{
+			//The entry at the head of the queue may always hold one chunk, so the writer can never be starved
+			std::unique_lock<std::mutex> lock( _mutex );
+			_condition.wait( lock, [&] { return _bufferedBytes + chunkLength <= _memoryBudget || (unit == _head && slot.chunks.empty()); } );
+			_bufferedBytes += chunkLength;
+			if ( !_freeBuffers.empty() ) {
+				chunk = std::move( _freeBuffers.back() );
+				_freeBuffers.pop_back();
+			}
+		}
+		chunk.resize( chunkLength );
+
+		size_t fileLength = position < length ? std::min( chunkLength, length - position ) : 0;
+		if ( fileLength > 0 ) {
+			PhaseTimer timer( Phase::Read );
+			size_t readLength = inputFile.read( &chunk[0], fileLength );
+			if ( readLength < fileLength ) {
+				//File shrank while being read, fill out the length already promised in the header
+				memset( &chunk[readLength], 0x00, fileLength - readLength );
+				shortRead = true;
+			}
+			checksum = crc32c( checksum, &chunk[0], fileLength );
+			countBytes( fileLength );
+		}
+		std::fill( chunk.begin() + fileLength, chunk.end(), cipher.paddingByte() );
+		{
+			PhaseTimer timer( Phase::Cipher );
+			cipher.update( &chunk[0], chunkLength );
+		}
+		position += chunkLength;
+
+		std::lock_guard<std::mutex> lock( _mutex );
+		slot.chunks.push_back( std::move( chunk ) );
+		_condition.notify_all();
+	}
+	inputFile.close();
+
+	if ( shortRead ) {
+		printf( "Error: \'%s\' changed while being read\n", job.sourceFile.u8string().c_str() );
+	}
+	std::lock_guard<std::mutex> lock( _mutex );
+	slot.dataPadLength = paddingLength;
+	slot.checksum = checksum;
+	slot.incomplete = shortRead;
+	slot.finished = true;
+	_condition.notify_all();
+}
+
+//Chunks are published as they come out of the compressor, so their sizes vary and the stored length is only known at the end
+void ParallelEncoder::encodeCompressedJob( size_t unit, size_t index, Slot& slot, std::unique_ptr<FeD_Entry> entry, AsyncFileReader& inputFile, size_t length ) {
+	const EncodeJob& job = (*_jobs)[index];
+	entry->setFlags( entry->flags() | compressedFlag );
+	entry->setOriginalLength( length );
+	entry->setDataPadLength( 0 );
+	entry->setDataLength( 0 );
+	CBCEncryptStream cipher( *_key, entry->initVector() );
+	{
+		std::lock_guard<std::mutex> lock( _mutex );
+		slot.entry = std::move( entry );
+		slot.opened = true;
+		_condition.notify_all();
+	}
+
+	BlockCompressor compressor;
+	std::vector<char> input( std::min( length, _bufferSize ) );
+	bool shortRead = false;
+	uint64_t storedLength = 0;
+	unsigned short paddingLength = 0;
+	uint32_t checksum = 0;
+	size_t position = 0;
+	while ( position < length || !input.empty() ) {
+		std::vector<char> chunk = this->newBuffer();
+
+		if ( position < length ) {
+			size_t inputLength = std::min( length - position, input.size() );
+			{
+				PhaseTimer timer( Phase::Read );
+				size_t readLength = inputFile.read( &input[0], inputLength );
+				if ( readLength < inputLength ) {
+					//File shrank while being read, fill out the length already recorded as the original length
+					memset( &input[readLength], 0x00, inputLength - readLength );
+					shortRead = true;
+				}
+				checksum = crc32c( checksum, &input[0], inputLength );
+				countBytes( inputLength );
+			}
+			PhaseTimer timer( Phase::Compression );
+			compressor.update( &input[0], inputLength, chunk );
+			position += inputLength;
+		}
+		else {
+			//Last pass flushes the compressor and pads out the stored data
+			PhaseTimer timer( Phase::Compression );
+			compressor.finish( chunk );
+			input.clear();
+			paddingLength = CBCEncryptStream::paddingLength( (size_t)(storedLength + chunk.size()) );
+			chunk.resize( chunk.size() + paddingLength, cipher.paddingByte() );
+		}
+		if ( chunk.empty() ) {
+			continue;
+		}
+		{
+			PhaseTimer timer( Phase::Cipher );
+			cipher.update( &chunk[0], chunk.size() );
+		}
+		storedLength += chunk.size();
+
+		std::unique_lock<std::mutex> lock( _mutex );
+		_condition.wait( lock, [&] { return _bufferedBytes + chunk.size() <= _memoryBudget || (unit == _head && slot.chunks.empty()); } );
+		_bufferedBytes += chunk.size();
+		slot.chunks.push_back( std::move( chunk ) );
+		_condition.notify_all();
+	}
+	inputFile.close();
+
+	if ( shortRead ) {
+		printf( "Error: \'%s\' changed while being read\n", job.sourceFile.u8string().c_str() );
+	}
+	std::lock_guard<std::mutex> lock( _mutex );
+	slot.dataPadLength = paddingLength;
+	slot.checksum = checksum;
+	slot.incomplete = shortRead;
+	slot.finished = true;
+	_condition.notify_all();
+}
+
+//Reads every member in full and encrypts the whole block at once, members that can't be read are left out of it
+//The block is built in a buffer from the pool and goes back to it once written, so blocks don't allocate once buffers have grown to their size
+void ParallelEncoder::encodeSolidBlock( size_t unit, Slot& slot, AsyncFileReader& inputFile ) {
+	const std::vector<size_t>& jobIndices = _units[unit];
+	std::vector<FeD_SolidMember> members;
+	std::vector<char> block = this->newBuffer();
+	bool incomplete = false;
+	for ( size_t index : jobIndices ) {
+		const EncodeJob& job = (*_jobs)[index];
+		std::string memberPath = encodePath( job.relativePath );
+		if ( memberPath.length() > pathMaxSize ) {
+			printf( "Error: Path of \'%s\' is too long to be stored\n", job.sourceFile.u8string().c_str() );
+			incomplete = true;
+			continue;
+		}
+		if ( !inputFile.open( job.sourceFile ) ) {
+			printf( "Error: Could not open \'%s\'\n", job.sourceFile.u8string().c_str() );
+			incomplete = true;
+			continue;
+		}
+		//The block was planned around the sizes found when scanning, so a file that has changed since can't be stored in it
+		size_t length = (size_t)inputFile.size();
+		size_t position = block.size();
+		block.resize( position + length );
+		size_t readLength;
+		{
+			PhaseTimer timer( Phase::Read );
+			readLength = length > 0 ? inputFile.read( &block[position], length ) : 0;
+			inputFile.close();
+			countBytes( readLength );
+		}
+		if ( length != job.size || readLength < length ) {
+			printf( "Error: \'%s\' changed while being read\n", job.sourceFile.u8string().c_str() );
+			block.resize( position );
+			incomplete = true;
+			continue;
+		}
+		members.push_back( { _firstIndex + (unsigned int)index, (uint32_t)length, std::move( memberPath ) } );
+	}
+	if ( members.empty() ) {
+		std::lock_guard<std::mutex> lock( _mutex );
+		_freeBuffers.push_back( std::move( block ) );
+		slot.failed = slot.finished = true;
+		_condition.notify_all();
+		return;
+	}
+
+	//Only known once every member has been read, the table is moved in ahead of their data within the same storage
+	std::string table;
+	writeSolidTable( members, table );
+	block.insert( block.begin(), table.begin(), table.end() );
+
+	std::unique_ptr<FeD_Entry> entry = this->newEntry( _firstIndex + (unsigned int)jobIndices.back() );
+	std::string sPath;
+	entry->setPathPadLength( encryptPath( sPath, *_key, entry->initVector() ) );
+	entry->setPath( &sPath[0], sPath.length() );
+	entry->setFlags( entry->flags() | solidFlag );
+	entry->setOriginalLength( block.size() );
+	uint32_t checksum = crc32c( 0, &block[0], block.size() );
+
+	if ( _compress && isCompressible( &block[0], std::min( block.size(), compressionProbeSize ) ) ) {
+		PhaseTimer timer( Phase::Compression );
+		BlockCompressor compressor;
+		std::vector<char> compressed = this->newBuffer();
+		compressor.update( &block[0], block.size(), compressed );
+		compressor.finish( compressed );
+		std::swap( block, compressed );
+		std::lock_guard<std::mutex> lock( _mutex );
+		_freeBuffers.push_back( std::move( compressed ) );
+		entry->setFlags( entry->flags() | compressedFlag );
+	}
+	CBCEncryptStream cipher( *_key, entry->initVector() );
+	unsigned short paddingLength = CBCEncryptStream::paddingLength( block.size() );
+	block.resize( block.size() + paddingLength, cipher.paddingByte() );
+	{
+		PhaseTimer timer( Phase::Cipher );
+		cipher.update( &block[0], block.size() );
+	}
+	entry->setDataPadLength( paddingLength );
+	entry->setDataLength( block.size() );
+
+	//The block goes out as a single chunk, so it may take more than its share of the memory budget when it's at the head of the queue
+	std::unique_lock<std::mutex> lock( _mutex );
+	_condition.wait( lock, [&] { return _bufferedBytes + block.size() <= _memoryBudget || unit == _head; } );
+	_bufferedBytes += block.size();
+	slot.dataPadLength = paddingLength;
+	slot.checksum = checksum;
+	slot.entry = std::move( entry );
+	slot.chunks.push_back( std::move( block ) );
+	slot.incomplete = incomplete;
+	slot.opened = slot.finished = true;
+	_condition.notify_all();
+}
+
+//Jobs are always committed before any job after them, so whatever job is waiting can't be holding up the one waited for
+bool ParallelEncoder::waitForJob( size_t index ) {
+	std::unique_lock<std::mutex> lock( _mutex );
+	_condition.wait( lock, [&] { return _jobStates[index] != JobState::Pending; } );
+	return _jobStates[index] == JobState::Stored;
+}
+
+//Stores only the index of the job this one duplicates
+void ParallelEncoder::encodeReference( size_t index, Slot& slot, std::unique_ptr<FeD_Entry> entry ) {
+	const EncodeJob& job = (*_jobs)[index];
+	uint64_t length = job.size;
+
+	std::vector<char> reference = this->newBuffer();
+	uint32_t targetIndex = _firstIndex + (uint32_t)job.duplicateOf;
+	reference.resize( sizeof( targetIndex ) );
+	memcpy( &reference[0], &targetIndex, sizeof( targetIndex ) );
+	CBCEncryptStream cipher( *_key, entry->initVector() );
+	unsigned short paddingLength = CBCEncryptStream::paddingLength( reference.size() );
+	reference.resize( reference.size() + paddingLength, cipher.paddingByte() );
+	cipher.update( &reference[0], reference.size() );
+	entry->setFlags( entry->flags() | referenceFlag );
+	entry->setOriginalLength( length );
+	entry->setDataPadLength( paddingLength );
+	entry->setDataLength( reference.size() );
+
+	std::lock_guard<std::mutex> lock( _mutex );
+	slot.dataPadLength = paddingLength;
+	slot.checksum = 0;
+	slot.entry = std::move( entry );
+	slot.opened = true;
+	_bufferedBytes += reference.size();
+	slot.chunks.push_back( std::move( reference ) );
+	slot.finished = true;
+	_condition.notify_all();
+}
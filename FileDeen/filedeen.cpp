@@ -1,83 +1,253 @@
 #include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <cwchar>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <memory>
 #include <random>
+#include <thread>
+#include <unordered_map>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+#include "checksum.h"
+#include "cipher.h"
+#include "compressor.h"
 #include "filedeen.h"
+#include "mappedfile.h"
+#include "metrics.h"
 using namespace FileDeen;
 
-unsigned short FileDeen::CBCEncrypt( std::string& data, std::string key, std::vector<char> initVector ) {
-	if ( key.length() == 0 ) {
-		key = "DEFAULT";
+unsigned short FileDeen::CBCEncrypt( std::string& data, std::string key, const InitVector& initVector ) {
+	return CBCEncrypt( data, KeyContext( key ), initVector );
+}
+
+//Pads and encrypts data from position of the keystream of initVector
+static unsigned short encrypt( std::string& data, const KeyContext& key, const InitVector& initVector, unsigned char versionByte, uint64_t position ) {
+	const CipherBackend& backend = cipherBackend( cipherScheme( versionByte ) );
+	char state[cipherStateSize];
+	backend.setup( key, &initVector[0], state );
+
+	unsigned short paddingLength = data.length() % blockSize;
+	data.append( paddingLength, key.paddingByte() );
+	if ( data.length() > 0 ) {
+		backend.apply( state, &data[0], &data[0], data.length(), position );
 	}
-	//Generate potentially cryptographically insecure pseudorandom 512-bit key from given key
-	std::seed_seq seed( key.begin(), key.end() );
-	std::mt19937_64 rng( seed );
-	std::uniform_int_distribution<short> dist( 0x00u, 0xFFu );
-	std::vector<char> randKey( blockSize );
-	for ( auto& c : randKey ) {
-		c = dist( rng );
+	return paddingLength;
+}
+
+static void decrypt( std::string& data, const KeyContext& key, const InitVector& initVector, unsigned char versionByte, uint64_t position ) {
+	const CipherBackend& backend = cipherBackend( cipherScheme( versionByte ) );
+	char state[cipherStateSize];
+	backend.setup( key, &initVector[0], state );
+
+	if ( data.length() > 0 ) {
+		backend.apply( state, &data[0], &data[0], data.length(), position );
 	}
+}
 
-	unsigned short paddingLength = data.length() % blockSize;
-	data.append( paddingLength, rng() );
-	std::string prevBlock( blockSize, 0x00 );
-	for ( size_t blockStart = 0; blockStart < data.length(); blockStart += blockSize ) {
-		std::string origPlain( data.substr( blockStart, blockSize ) );
-		for ( size_t blockPos = 0; blockPos < blockSize; blockPos++ ) {
-			if ( blockStart + blockPos >= data.length() ) {
+unsigned short FileDeen::CBCEncrypt( std::string& data, const KeyContext& key, const InitVector& initVector, unsigned char versionByte ) {
+	return encrypt( data, key, initVector, versionByte, 0 );
+}
+
+void FileDeen::CBCDecrypt( std::string& data, std::string key, const InitVector& initVector ) {
+	CBCDecrypt( data, KeyContext( key ), initVector );
+}
+
+void FileDeen::CBCDecrypt( std::string& data, const KeyContext& key, const InitVector& initVector, unsigned char versionByte ) {
+	decrypt( data, key, initVector, versionByte, 0 );
+}
+
+unsigned short FileDeen::encryptPath( std::string& path, const KeyContext& key, const InitVector& initVector ) {
+	return encrypt( path, key, initVector, formatVersion, pathCipherPosition );
+}
+
+void FileDeen::decryptPath( std::string& path, const KeyContext& key, const InitVector& initVector, unsigned char versionByte ) {
+	decrypt( path, key, initVector, versionByte, pathCipherPosition );
+}
+
+CipherScheme FileDeen::cipherScheme( unsigned char versionByte ) {
+	return versionByte >= 0x0A ? CipherScheme::AESCTR : CipherScheme::BlockMasks;
+}
+
+
+
+CBCEncryptStream::CBCEncryptStream( std::string key, const InitVector& initVector ) : CBCEncryptStream( KeyContext( key ), initVector ) {
+}
+
+CBCEncryptStream::CBCEncryptStream( const KeyContext& key, const InitVector& initVector, unsigned char versionByte ) {
+	_backend = &cipherBackend( cipherScheme( versionByte ) );
+	_backend->setup( key, &initVector[0], _state );
+	_paddingByte = key.paddingByte();
+	_position = 0;
+}
+
+void CBCEncryptStream::update( char* data, size_t length ) {
+	_backend->apply( _state, data, data, length, _position );
+	_position += length;
+}
+
+CBCDecryptStream::CBCDecryptStream( std::string key, const InitVector& initVector ) : CBCDecryptStream( KeyContext( key ), initVector ) {
+}
+
+CBCDecryptStream::CBCDecryptStream( const KeyContext& key, const InitVector& initVector, unsigned char versionByte ) {
+	_backend = &cipherBackend( cipherScheme( versionByte ) );
+	_backend->setup( key, &initVector[0], _state );
+	_position = 0;
+}
+
+void CBCDecryptStream::update( char* data, size_t length ) {
+	_backend->apply( _state, data, data, length, _position );
+	_position += length;
+}
+
+void CBCDecryptStream::update( const char* source, char* destination, size_t length ) {
+	_backend->apply( _state, source, destination, length, _position );
+	_position += length;
+}
+
+
+
+std::string FileDeen::encodePath( const std::filesystem::path& path ) {
+	std::u16string units;
+#if WCHAR_MAX <= 0xFFFF
+	std::wstring wide = path.wstring();
+	units.assign( wide.begin(), wide.end() );
+#else
+	//Native paths are UTF-8, invalid sequences are stored as U+FFFD
+	std::string narrow = path.string();
+	for ( size_t i = 0; i < narrow.size(); ) {
+		unsigned char lead = narrow[i];
+		int extraBytes = lead < 0x80 ? 0 : lead >= 0xF5 ? -1 : lead >= 0xF0 ? 3 : lead >= 0xE0 ? 2 : lead >= 0xC2 ? 1 : -1;
+		char32_t codePoint = extraBytes == 0 ? lead : extraBytes > 0 ? lead & (0x3F >> extraBytes) : 0xFFFD;
+		size_t end = i + 1;
+		for ( int j = 0; j < extraBytes; j++, end++ ) {
+			if ( end >= narrow.size() || ((unsigned char)narrow[end] & 0xC0) != 0x80 ) {
+				codePoint = 0xFFFD;
 				break;
 			}
-			data[blockStart+blockPos] = ((blockStart == 0 ? initVector[blockPos] : prevBlock[blockPos]) ^ data[blockStart+blockPos]) ^ randKey[blockPos];
-			prevBlock[blockPos] = data[blockStart+blockPos] ^ origPlain[blockPos];
+			codePoint = (codePoint << 6) | ((unsigned char)narrow[end] & 0x3F);
+		}
+		i = codePoint == 0xFFFD ? i + 1 : end;
+		if ( codePoint >= 0x10000 ) {
+			units.push_back( (char16_t)(0xD800 + ((codePoint - 0x10000) >> 10)) );
+			units.push_back( (char16_t)(0xDC00 + ((codePoint - 0x10000) & 0x3FF)) );
+		}
+		else {
+			units.push_back( (char16_t)codePoint );
 		}
 	}
-	return paddingLength;
+#endif
+	std::string data( units.size()*2, 0x00 );
+	for ( size_t i = 0; i < units.size(); i++ ) {
+		char16_t unit = units[i] == u'/' ? u'\\' : units[i];
+		data[i*2] = (char)(unit & 0xFF);
+		data[i*2+1] = (char)(unit >> 8);
+	}
+	return data;
 }
 
-void FileDeen::CBCDecrypt( std::string& data, std::string key, std::vector<char> initVector ) {
-	if ( key.length() == 0 ) {
-		key = "DEFAULT";
-	}
-	//Generate potentially cryptographically insecure pseudorandom 512-bit key from given key
-	std::seed_seq seed( key.begin(), key.end() );
-	std::mt19937_64 rng( seed );
-	std::uniform_int_distribution<short> dist( 0x00u, 0xFFu );
-	std::vector<char> randKey( blockSize );
-	for ( auto& c : randKey ) {
-		c = dist( rng );
+//Stops at the first null character, like the fixed size path buffers of older versions did
+std::filesystem::path FileDeen::decodePath( const char* data, size_t length ) {
+	std::u16string units;
+	for ( size_t i = 0; i+1 < length; i += 2 ) {
+		char16_t unit = (unsigned char)data[i] | ((unsigned char)data[i+1] << 8);
+		if ( unit == 0 ) {
+			break;
+		}
+		units.push_back( unit );
 	}
+#if WCHAR_MAX <= 0xFFFF
+	return std::wstring( units.begin(), units.end() );
+#else
+	std::string narrow;
+	for ( size_t i = 0; i < units.size(); i++ ) {
+		char32_t codePoint = units[i] == u'\\' ? u'/' : units[i];
+		if ( codePoint >= 0xD800 && codePoint < 0xDC00 && i+1 < units.size() && units[i+1] >= 0xDC00 && units[i+1] < 0xE000 ) {
+			codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (units[++i] - 0xDC00);
+		}
+		else if ( codePoint >= 0xD800 && codePoint < 0xE000 ) {
+			codePoint = 0xFFFD;
+		}
 
-	std::string prevBlock( blockSize, 0x00 );
-	for ( size_t blockStart = 0; blockStart < data.length(); blockStart += blockSize ) {
-		std::string origCiph( data.substr( blockStart, blockSize ) );
-		for ( size_t blockPos = 0; blockPos < blockSize; blockPos++ ) {
-			if ( blockStart + blockPos >= data.length() ) {
-				break;
-			}
-			data[blockStart+blockPos] = (data[blockStart+blockPos] ^ randKey[blockPos]) ^ (blockStart == 0 ? initVector[blockPos] : prevBlock[blockPos]);
-			prevBlock[blockPos] = data[blockStart+blockPos] ^ origCiph[blockPos];
+		if ( codePoint < 0x80 ) {
+			narrow += (char)codePoint;
+		}
+		else if ( codePoint < 0x800 ) {
+			narrow += (char)(0xC0 | (codePoint >> 6));
+			narrow += (char)(0x80 | (codePoint & 0x3F));
+		}
+		else if ( codePoint < 0x10000 ) {
+			narrow += (char)(0xE0 | (codePoint >> 12));
+			narrow += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+			narrow += (char)(0x80 | (codePoint & 0x3F));
+		}
+		else {
+			narrow += (char)(0xF0 | (codePoint >> 18));
+			narrow += (char)(0x80 | ((codePoint >> 12) & 0x3F));
+			narrow += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+			narrow += (char)(0x80 | (codePoint & 0x3F));
 		}
 	}
+	return narrow;
+#endif
+}
+
+static std::atomic<VersionMismatch> activeVersionMismatch( VersionMismatch::Ask );
+
+void FileDeen::setVersionMismatch( VersionMismatch action ) {
+	activeVersionMismatch = action;
+}
+
+VersionMismatch FileDeen::versionMismatch() {
+	return activeVersionMismatch;
+}
+
+
+
+FeD_Entry::FeD_Entry() {
+	clear();
 }
 
+FeD_Entry::FeD_Entry( uint64_t initVectorSeed ) {
+	clear();
+	regenerateInitVector( initVectorSeed );
+}
 
+FeD_Entry FeD_Entry::copyHeader() const {
+	FeD_Entry copy;
+	copy._index = _index;
+	copy._checksum = _checksum;
+	copy._initVector = _initVector;
+	copy._pathLength = _pathLength;
+	copy._pathPadLength = _pathPadLength;
+	copy._path = _path;
+	copy._dataLength = _dataLength;
+	copy._dataPadLength = _dataPadLength;
+	copy._flags = _flags;
+	copy._originalLength = _originalLength;
+	return copy;
+}
 
-FeD_Entry::FeD_Entry( std::seed_seq initVectorSeed ) : _initVector( blockSize ) {
-	_index = NULL;
-	_pathLength = pathMaxSize;
+void FeD_Entry::clear() {
+	_index = 0;
+	_checksum = 0;
+	_initVector.fill( 0 );
+	_pathLength = 0;
 	_pathPadLength = 0;
-	_path.resize( pathMaxSize/2 );
+	_path.clear();
 	_dataLength = 0;
 	_dataPadLength = 0;
-	_checksum = NULL;
-	std::mt19937_64 rng( initVectorSeed );
-	std::uniform_int_distribution<short> dist( 0x00u, 0xFFu );
-	for ( auto& c : _initVector ) {
-		c = dist( rng );
-	}
+	_flags = 0;
+	_originalLength = 0;
+	_data.clear();
 }
 
-void FeD_Entry::setIndex( char* c, size_t length ) {
+void FeD_Entry::setIndex( const char* c, size_t length ) {
 	memcpy( &_index, c, length );
 }
 
@@ -85,43 +255,65 @@ void FeD_Entry::setIndex( unsigned int i ) {
 	_index = i;
 }
 
-//Size of given vector should equal blockSize
-void FeD_Entry::setInitVector( std::vector<char> v ) {
-	_initVector = v;
+//Reads initVectorSize bytes
+void FeD_Entry::setInitVector( const char* v ) {
+	memcpy( _initVector.data(), v, initVectorSize );
 }
 
-void FeD_Entry::regenerateInitVector( std::seed_seq seed ) {
-	std::mt19937_64 rng( seed );
-	std::uniform_int_distribution<short> dist( 0x00u, 0xFFu );
-	for ( auto& c : _initVector ) {
-		c = dist( rng );
+//SplitMix64, fills the whole vector from a single seed without any state to allocate
+void FeD_Entry::regenerateInitVector( uint64_t seed ) {
+	for ( size_t i = 0; i < initVectorSize; i += sizeof( uint64_t ) ) {
+		seed += 0x9E3779B97F4A7C15ull;
+		uint64_t z = seed;
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+		z ^= z >> 31;
+		memcpy( &_initVector[i], &z, sizeof( z ) );
 	}
 }
 
-void FeD_Entry::setPath( char* c, size_t length ) {
-	memcpy( &_path[0], c, length );
+//Raw path bytes as stored, encrypted or not
+void FeD_Entry::setPath( const char* c, size_t length ) {
+	_path.assign( c, length );
 	_pathLength = length;
 }
 
-void FeD_Entry::setPath( std::wstring s ) {
-	_path = s;
-	_pathLength = s.length()*2;
+void FeD_Entry::setPath( std::filesystem::path path ) {
+	_path = encodePath( path );
+	_pathLength = _path.size();
 }
 
 void FeD_Entry::setPathPadLength( unsigned short i ) {
 	_pathPadLength = i;
 }
 
-void FeD_Entry::setData( char* c, size_t length ) {
+void FeD_Entry::setData( const char* c, size_t length ) {
 	_data.resize( length );
 	_dataLength = length;
 	memcpy( &_data[0], c, length );
 }
 
+//Length of the data as stored, padding included
+void FeD_Entry::setDataLength( size_t length ) {
+	_dataLength = length;
+}
+
 void FeD_Entry::setDataPadLength( unsigned short i ) {
 	_dataPadLength = i;
 }
 
+void FeD_Entry::setFlags( unsigned char flags ) {
+	_flags = flags;
+}
+
+void FeD_Entry::setChecksum( unsigned int checksum ) {
+	_checksum = checksum;
+}
+
+void FeD_Entry::setOriginalLength( uint64_t length ) {
+	_originalLength = length;
+}
+
 //Uses move semantics to account for larger file sizes
 void FeD_Entry::moveData( std::string& s ) {
 	_data = std::move( s );
@@ -134,21 +326,53 @@ void FeD_Entry::writeDataToFile( std::filesystem::path filePath ) {
 	outputFile.close();
 }
 
-//'Ez write' function
-void FeD_Entry::writeToFile( std::filesystem::path rootFolder, bool useRealNames, bool verboseLogging ) {
-	std::filesystem::path outputFileName;
+void FeD_Entry::writeHeader( std::string& header ) const {
+	auto append = [&]( const void* data, size_t length ) {
+		header.append( (const char*)data, length );
+	};
+	append( &_index, sizeof( _index ) );
+	append( &_initVector[0], blockSize );
+	append( &_pathLength, sizeof( _pathLength ) );
+	append( &_pathPadLength, sizeof( _pathPadLength ) );
+	append( &_path[0], _pathLength );
+	uint64_t originalLength = _flags & (compressedFlag | referenceFlag) ? _originalLength : _dataLength - _dataPadLength;
+	append( &_flags, sizeof( _flags ) );
+	append( &originalLength, sizeof( originalLength ) );
+}
+
+std::filesystem::path FeD_Entry::outputPath( const std::filesystem::path& rootFolder, bool useRealNames ) const {
+	std::filesystem::path entryPath = this->path();
+	if ( entryPath.has_root_path() || std::any_of( entryPath.begin(), entryPath.end(), []( const std::filesystem::path& part ) { return part == ".."; } ) ) {
+		return std::filesystem::path();
+	}
 	if ( useRealNames ) {
-		outputFileName = rootFolder.wstring() + L"\\" + _path;
+		return rootFolder / entryPath;
+	}
+	return rootFolder / entryPath.parent_path() / (std::to_string( _index ) + entryPath.extension().string());
+}
+
+//'Ez write' function
+void FeD_Entry::writeToFile( std::filesystem::path rootFolder, bool useRealNames, bool verboseLogging, DirectoryCache* folders ) {
+	std::filesystem::path outputFileName = this->outputPath( rootFolder, useRealNames );
+	if ( outputFileName.empty() ) {
+		printf( "Error: Entry %u has a path outside the folder it's decoded to\n", _index );
+		return;
+	}
+	if ( folders != nullptr ) {
+		folders->create( outputFileName.parent_path() );
 	}
 	else {
-		outputFileName = rootFolder.wstring() + L"\\" + this->path().parent_path().wstring() + L"\\" + std::to_wstring( _index ) + this->path().extension().wstring();
+		std::error_code error;
+		std::filesystem::create_directories( outputFileName.parent_path(), error );
 	}
-	std::filesystem::create_directories( outputFileName.parent_path() );
-	if ( verboseLogging ) wprintf( L"%.3u: Writing to \'%ls\'...", _index, outputFileName.c_str() );
-	std::fstream outputFile( outputFileName, std::ios::out | std::ios::binary | std::ios::trunc );
-	outputFile.write( &_data[0], _dataLength );
+	if ( verboseLogging ) printf( "%.3u: Writing to \'%s\'...", _index, outputFileName.u8string().c_str() );
+	AsyncFileWriter outputFile;
+	outputFile.open( outputFileName );
+	outputFile.preallocate( _dataLength );
+	outputFile.write( _data.data(), _dataLength );
 	outputFile.close();
-	if ( verboseLogging ) printf( "Done!\n" );
+	int result = outputFile.finish();
+	if ( verboseLogging ) printf( result == 0 ? "Done!\n" : "Failed!\n" );
 }
 FeD_Entry& FeD::entry( int index ) {
 	return _entries.at( index );
@@ -161,12 +385,12 @@ FeD::FeD() : _entries(), _signature( signSize, 0x00 ) {
 }
 
 
-void FeD::setSignature( char* cSign, size_t length ) {
+void FeD::setSignature( const char* cSign, size_t length ) {
 	memcpy( &_signature[0], cSign, length );
 };
 
-void FeD::addEntry( FeD_Entry e ) {
-	_entries.push_back( e );
+void FeD::addEntry( FeD_Entry&& e ) {
+	_entries.push_back( std::move( e ) );
 }
 
 //Uses move semantics to account for larger file sizes
@@ -179,144 +403,2065 @@ void FeD::delEntry( int index ) {
 	_entries.erase( _entries.begin()+index );
 }
 
+//Collects visited entries, data included, into a FeD
+namespace {
+	class EntryCollector : public FeD_EntryVisitor {
+	public:
+		EntryCollector( FeD& fedFile ) : _fedFile( fedFile ) {};
+
+		void beginEntry( const FeD_Entry& entry ) override {
+			_data.clear();
+			_data.reserve( entry.dataLength() );
+		}
+		void entryData( const FeD_Entry&, const char* data, size_t length ) override {
+			_data.append( data, length );
+		}
+		void endEntry( const FeD_Entry& entry ) override {
+			//Data arrives decompressed and with references resolved, so the copy is a plain entry
+			FeD_Entry copy = entry.copyHeader();
+			copy.setFlags( entry.flags() & ~(compressedFlag | referenceFlag) );
+			copy.moveData( _data );
+			_fedFile.moveEntry( copy );
+		}
+
+	private:
+		FeD& _fedFile;
+		std::string _data;
+	};
+}
+
 //'Ez read' function
 int FeD::readFromFile( std::filesystem::path fileName, std::string key, bool verboseLogging ) {
-	std::fstream inputFile( fileName, std::ios::in | std::ios::binary );
-	std::string buffer;
+	EntryCollector collector( *this );
+	return this->readFromFile( fileName, key, verboseLogging, collector );
+}
+
+//Reads entries either through an fstream or straight out of a memory mapped file
+//Pointers returned by read() and peek() stay valid until the next call
+class FileDeen::EntrySource {
+public:
+	virtual ~EntrySource() {};
+
+	virtual const char* read( size_t length ) = 0;
+	virtual const char* peek( size_t length ) = 0;
+	virtual bool seek( uint64_t position ) = 0;
+	virtual uint64_t position() = 0;
+	virtual uint64_t size() = 0;
+
+	//Called before reading a large region, so it can be fetched ahead of time
+	virtual void willRead( uint64_t ) {};
+};
+
+namespace {
+	//Copies everything it reads into an internal buffer
+	class StreamSource : public EntrySource {
+	public:
+		bool open( std::filesystem::path fileName ) {
+			_inputFile.open( fileName, std::ios::in | std::ios::binary );
+			return (bool)_inputFile;
+		}
+
+		const char* read( size_t length ) override {
+			if ( _buffer.size() < std::max( length, (size_t)1 ) ) {
+				_buffer.resize( std::max( length, (size_t)1 ) );
+			}
+			_inputFile.read( &_buffer[0], length );
+			return _inputFile ? &_buffer[0] : nullptr;
+		}
+
+		const char* peek( size_t length ) override {
+			std::streampos start = _inputFile.tellg();
+			const char* data = this->read( length );
+			_inputFile.clear();
+			_inputFile.seekg( start );
+			return data;
+		}
+
+		bool seek( uint64_t position ) override {
+			_inputFile.clear();
+			_inputFile.seekg( position );
+			return (bool)_inputFile;
+		}
+
+		uint64_t position() override {
+			return _inputFile.tellg();
+		}
+
+		uint64_t size() override {
+			std::streampos start = _inputFile.tellg();
+			_inputFile.seekg( 0, std::ios::end );
+			uint64_t fileSize = _inputFile.tellg();
+			_inputFile.seekg( start );
+			return fileSize;
+		}
+
+	private:
+		std::fstream _inputFile;
+		std::vector<char> _buffer;
+	};
+
+	//Parses the file in place, nothing is copied until data is decrypted out of the mapping
+	class MappedSource : public EntrySource {
+	public:
+		bool open( std::filesystem::path fileName ) {
+			if ( !_mappedFile.open( fileName ) ) {
+				return false;
+			}
+			_mappedFile.adviseSequential();
+			_position = 0;
+			return true;
+		}
+
+		const char* read( size_t length ) override {
+			const char* data = this->peek( length );
+			_position = data != nullptr ? _position + length : _mappedFile.size();
+			return data;
+		}
+
+		const char* peek( size_t length ) override {
+			if ( length > _mappedFile.size() - _position ) {
+				return nullptr;
+			}
+			return _mappedFile.data() + _position;
+		}
+
+		bool seek( uint64_t position ) override {
+			if ( position > _mappedFile.size() ) {
+				return false;
+			}
+			_position = position;
+			return true;
+		}
+
+		uint64_t position() override {
+			return _position;
+		}
 
+		uint64_t size() override {
+			return _mappedFile.size();
+		}
+
+		void willRead( uint64_t length ) override {
+			_mappedFile.adviseWillNeed( _position, length );
+		}
+
+	private:
+		MappedFile _mappedFile;
+		uint64_t _position;
+	};
+
+	//Reads standard input, which can only be read front to back, so seeking back fails and the size is unknown
+	//Data is buffered so peeked bytes can still be read after, the buffer grows to fit the largest read
+	class InputSource : public EntrySource {
+	public:
+		InputSource() : _buffer( 1 << 20 ), _start( 0 ), _end( 0 ), _position( 0 ) {
+#ifdef _WIN32
+			_setmode( _fileno( stdin ), _O_BINARY );
+#endif
+		}
+
+		const char* read( size_t length ) override {
+			const char* data = this->peek( length );
+			if ( data == nullptr ) {
+				return nullptr;
+			}
+			_start += length;
+			_position += length;
+			return data;
+		}
+
+		const char* peek( size_t length ) override {
+			if ( _end - _start >= length ) {
+				return &_buffer[_start];
+			}
+			//Move what's left to the front, so the rest of the buffer can be filled
+			memmove( &_buffer[0], &_buffer[_start], _end - _start );
+			_end -= _start;
+			_start = 0;
+			if ( _buffer.size() < length ) {
+				_buffer.resize( length );
+			}
+			while ( _end < length ) {
+				size_t readLength = fread( &_buffer[_end], 1, _buffer.size() - _end, stdin );
+				if ( readLength == 0 ) {
+					return nullptr;
+				}
+				_end += readLength;
+			}
+			return &_buffer[0];
+		}
+
+		bool seek( uint64_t position ) override {
+			if ( position < _position ) {
+				return false;
+			}
+			while ( position > _position ) {
+				size_t skipLength = (size_t)std::min( position - _position, (uint64_t)_buffer.size() );
+				if ( this->read( skipLength ) == nullptr ) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		uint64_t position() override {
+			return _position;
+		}
+
+		uint64_t size() override {
+			return UINT64_MAX;
+		}
+
+	private:
+		std::vector<char> _buffer;
+		size_t _start, _end;
+		uint64_t _position;
+	};
+}
+
+//Maps the file when possible, and falls back to regular reads for files that can't be mapped
+//Readers that skip over most of the file shouldn't map it, the sequential hint would have the OS read ahead what they skip
+static std::unique_ptr<EntrySource> openEntrySource( std::filesystem::path fileName, bool mapFile = true ) {
+	std::unique_ptr<MappedSource> mappedSource( new MappedSource() );
+	if ( mapFile && mappedSource->open( fileName ) ) {
+		return mappedSource;
+	}
+	std::unique_ptr<StreamSource> streamSource( new StreamSource() );
+	if ( streamSource->open( fileName ) ) {
+		return streamSource;
+	}
+	printf( "Error: Could not open \'%s\'\n", fileName.u8string().c_str() );
+	return nullptr;
+}
+
+template <typename T>
+static bool readValue( EntrySource& source, T& value ) {
+	const char* data = source.read( sizeof( T ) );
+	if ( data == nullptr ) {
+		return false;
+	}
+	memcpy( &value, data, sizeof( T ) );
+	return true;
+}
+
+//Checks signature and version, leaving the source positioned at the first entry
+static int readPreamble( EntrySource& source, bool verboseLogging, std::string& signature, unsigned char& versionByte ) {
 	//Check signature
 	if ( verboseLogging ) printf( "Checking signature..." );
-	buffer.resize( signSize );
-	inputFile.read( &buffer[0], signSize );
-	if ( memcmp( &buffer[0], SIGN, signSize ) != NULL ) {
+	const char* data = source.read( signSize );
+	if ( data == nullptr || memcmp( data, SIGN, signSize ) != 0 ) {
 		printf( "Error: File is not a FeD file\n" );
 		return 1;
 	}
-	_signature = buffer;
+	signature.assign( data, signSize );
 	if ( verboseLogging ) printf( "Done!\n" );
 
-	//Check version
+	//Check version, every version from minimumFormatVersion onwards can be read, entry layouts differ only in what their headers hold
 	if ( verboseLogging ) printf( "Checking version..." );
-	unsigned char versionByte = inputFile.peek();
-	if ( versionByte != _versionByte ) {
+	data = source.peek( sizeof( short ) );
+	if ( data == nullptr ) {
+		printf( "Error: Unexpected end of file\n" );
+		return 1;
+	}
+	versionByte = data[0];
+	if ( versionByte < minimumFormatVersion || versionByte > formatVersion ) {
 		short nextTwoBytes;
-		inputFile.read( (char*)&nextTwoBytes, sizeof( nextTwoBytes ) );
-		inputFile.seekg( -(signed)sizeof( nextTwoBytes ), std::ios::cur );
+		memcpy( &nextTwoBytes, data, sizeof( nextTwoBytes ) );
 		if ( nextTwoBytes % 2 == 0 && nextTwoBytes <= 512 ) {
 			printf( "Error:	FeD file was encoded before version checking was added.\nComplete decoding is not guaranteed\n" );
 		}
-		else if ( versionByte < _versionByte ) {
-			printf( "Error: FeD file was encoded with past encoding scheme \'v%u\', whereas the current decoding scheme is \'v%u\'.\nComplete decoding is not guaranteed\n", versionByte, _versionByte );
-			inputFile.seekg( 1, std::ios::cur );
+		else if ( versionByte < formatVersion ) {
+			printf( "Error: FeD file was encoded with past encoding scheme \'v%u\', whereas the current decoding scheme is \'v%u\'.\nComplete decoding is not guaranteed\n", versionByte, formatVersion );
+			source.read( versionSize );
 		}
-		else if ( versionByte > _versionByte ) {
-			printf( "Error: FeD file was encoded with future encoding scheme \'v%u\', whereas the current decoding scheme is \'v%u\'.\nComplete decoding is not guaranteed.\n", versionByte, _versionByte );
-			inputFile.seekg( 1, std::ios::cur );
-		}
-		printf( "Do you wish to continue? (y/n): " );
-		if ( getchar() == 'n' ) {
-			std::cin.ignore();
-			return 1;
+		else if ( versionByte > formatVersion ) {
+			printf( "Error: FeD file was encoded with future encoding scheme \'v%u\', whereas the current decoding scheme is \'v%u\'.\nComplete decoding is not guaranteed.\n", versionByte, formatVersion );
+			source.read( versionSize );
 		}
-		else {
-			std::cin.ignore();
+		switch ( versionMismatch() ) {
+			case VersionMismatch::Ask:
+				printf( "Do you wish to continue? (y/n): " );
+				if ( getchar() == 'n' ) {
+					std::cin.ignore();
+					return 1;
+				}
+				std::cin.ignore();
+				break;
+			case VersionMismatch::Refuse:
+				return 1;
+			case VersionMismatch::Continue:
+				break;
 		}
 	}
 	else {
 		if ( verboseLogging ) printf( "Done!: \'v%u\'\n", versionByte );
-		inputFile.seekg( 1, std::ios::cur );
+		source.read( versionSize );
 	}
+	return 0;
+}
 
-	while ( true ) {
-		FileDeen::FeD_Entry entry( { (unsigned)time( NULL ) } );
+//Only checks the signature, versions that can't be read with certainty are reported once the file is actually read
+int FileDeen::readVersion( std::filesystem::path fileName, unsigned char& versionByte ) {
+	std::unique_ptr<EntrySource> source = openEntrySource( fileName, false );
+	if ( source == nullptr ) {
+		return 1;
+	}
+	const char* data = source->read( metadataSize );
+	if ( data == nullptr || memcmp( data, SIGN, signSize ) != 0 ) {
+		printf( "Error: File is not a FeD file\n" );
+		return 1;
+	}
+	versionByte = data[signSize];
+	return 0;
+}
 
-		//Read index
-		if ( verboseLogging ) printf( "Reading index..." );
-		buffer.resize( sizeof( entry.index() ) );
-		inputFile.read( &buffer[0], buffer.size() );
-		entry.setIndex( &buffer[0], buffer.size() );
+namespace {
+	struct VolumeInfo {
+		uint64_t set;
+		uint32_t number, count;
+	};
+}
 
-		if ( entry.index() == 0xFFFFFFFF ) {
-			if ( verboseLogging ) printf( "End of file found\n" );
-			inputFile.close();
-			break;
+//Leaves the source wherever it was read up to
+static bool readVolumeInfo( EntrySource& source, VolumeInfo& info ) {
+	uint64_t fileSize = source.size();
+	if ( fileSize < (uint64_t)metadataSize + volumeInfoSize + directoryFooterSize || !source.seek( fileSize - directoryFooterSize - volumeInfoSize ) ||
+		!readValue( source, info.set ) || !readValue( source, info.number ) || !readValue( source, info.count ) ) {
+		return false;
+	}
+	const char* volumeSign = source.read( sizeof( VOLUME_SIGN ) );
+	return volumeSign != nullptr && memcmp( volumeSign, VOLUME_SIGN, sizeof( VOLUME_SIGN ) ) == 0 && info.number >= 1 && info.number <= info.count;
+}
+
+static bool readVolumeInfo( std::filesystem::path fileName, VolumeInfo& info ) {
+	std::error_code error;
+	if ( !std::filesystem::is_regular_file( fileName, error ) ) {
+		return false;
+	}
+	std::unique_ptr<EntrySource> source = openEntrySource( fileName, false );
+	return source != nullptr && readVolumeInfo( *source, info );
+}
+
+std::filesystem::path FileDeen::volumePath( const std::filesystem::path& folder, const std::filesystem::path& fileName, unsigned int number ) {
+	char suffix[16];
+	snprintf( suffix, sizeof( suffix ), ".%03u", number );
+	std::filesystem::path volume = folder / fileName;
+	volume += suffix;
+	return volume;
+}
+
+//Volumes only count if they belong to the same file as the one found first, leftovers of an earlier file of the same name are passed over
+int FileDeen::findVolumes( std::filesystem::path fileName, const std::vector<std::filesystem::path>& folders, std::vector<std::filesystem::path>& volumes ) {
+	volumes.clear();
+	VolumeInfo info;
+	std::filesystem::path baseName;
+	std::error_code error;
+	if ( std::filesystem::exists( fileName, error ) ) {
+		if ( !readVolumeInfo( fileName, info ) ) {
+			volumes.push_back( fileName );
+			return 0;
+		}
+		baseName = fileName.parent_path() / fileName.stem();
+	}
+	else if ( readVolumeInfo( volumePath( fileName.parent_path(), fileName.filename(), 1 ), info ) ) {
+		baseName = fileName;
+	}
+	else {
+		volumes.push_back( fileName );
+		return 0;
+	}
+
+	std::vector<std::filesystem::path> searchFolders = { baseName.parent_path() };
+	searchFolders.insert( searchFolders.end(), folders.begin(), folders.end() );
+	for ( uint32_t number = 1; number <= info.count; number++ ) {
+		bool found = false;
+		for ( const auto& folder : searchFolders ) {
+			std::filesystem::path volume = volumePath( folder, baseName.filename(), number );
+			VolumeInfo volumeInfo;
+			if ( readVolumeInfo( volume, volumeInfo ) && volumeInfo.set == info.set && volumeInfo.number == number && volumeInfo.count == info.count ) {
+				volumes.push_back( volume );
+				found = true;
+				break;
+			}
+		}
+		if ( !found ) {
+			printf( "Error: Volume %u of %u of \'%s\' is missing\n", number, info.count, baseName.u8string().c_str() );
+			return 1;
 		}
-		else if ( verboseLogging ) {
-			printf( "Done!: %.3u\n", entry.index() );
-		}
-
-		//Read initialization vector
-		if ( verboseLogging ) printf( "Reading initialization vector..." );
-		std::vector<char> initVector( blockSize );
-		inputFile.read( &initVector[0], initVector.size() );
-		entry.setInitVector( initVector );
-		if ( verboseLogging ) printf( "Done!\n" );
-
-		//Read path size
-		if ( verboseLogging ) printf( "%.3u: Reading path length...", entry.index() );
-		unsigned short pathLength;
-		inputFile.read( (char*)&pathLength, sizeof( pathLength ) );
-		if ( verboseLogging ) printf( "Done!: %hu\n", pathLength );
-
-		//Read path padding size
-		if ( verboseLogging ) printf( "%.3u: Reading path padding length...", entry.index() );
-		unsigned short pathPadLength;
-		inputFile.read( (char*)&pathPadLength, sizeof( pathPadLength ) );
-		if ( verboseLogging ) printf( "Done!: %hu\n", pathPadLength );
-
-		//Read path
-		if ( verboseLogging ) printf( "%.3u: Reading path...", entry.index() );
-		buffer.resize( pathLength );
-		inputFile.read( &buffer[0], buffer.size() );
-		CBCDecrypt( buffer, key, entry.initVector() );
-		buffer.resize( buffer.size()-pathPadLength );
-		entry.setPath( &buffer[0], buffer.size() );
-		if ( verboseLogging ) printf( "Done!\n" );
-
-		//Read data length
-		if ( verboseLogging ) printf( "%.3u: Reading data length...", entry.index() );
-		size_t dataLength;
-		inputFile.read( (char*)&dataLength, sizeof( dataLength ) );
-		if ( verboseLogging ) printf( "Done!: %zu\n", dataLength );
-
-		//Read data padding size
-		if ( verboseLogging ) printf( "%.3u: Reading data padding length...", entry.index() );
-		unsigned short dataPadLength;
-		inputFile.read( (char*)&dataPadLength, sizeof( dataPadLength ) );
-		if ( verboseLogging ) printf( "Done!: %hu\n", dataPadLength );
-
-		//Read data
-		if ( verboseLogging ) printf( "%.3u: Reading data...", entry.index() );
-		buffer.resize( dataLength );
-		inputFile.read( &buffer[0], buffer.size() );
-		CBCDecrypt( buffer, key, entry.initVector() );
-		buffer.resize( buffer.size()-dataPadLength );
-		entry.moveData( buffer );
-		if ( verboseLogging ) printf( "Done!\n" );
-
-		this->moveEntry( entry );
 	}
 	return 0;
 }
 
-//Write FeD class to file
-void FeD::writeToFile( std::filesystem::path fileName ) {
-	std::fstream outputFile( fileName, std::ios::out | std::ios::binary | std::ios::trunc );
-	
-	outputFile.write( &_signature[0], _signature.size() );  //Write signature
-	outputFile.put( _versionByte );  //Put version byte
-	for ( const auto& entry : _entries ) {  //Iterate through entry vector and write each in sequence
-		outputFile.write( (const char*)&entry._index, sizeof( entry._index ) );
-		outputFile.write( (const char*)&entry._initVector[0], blockSize );
-		outputFile.write( (const char*)&entry._pathLength, sizeof( entry._pathLength ) );
-		outputFile.write( (const char*)&entry._pathPadLength, sizeof( entry._pathPadLength ) );
-		outputFile.write( (const char*)&entry._path[0], entry._pathLength );
-		outputFile.write( (const char*)&entry._dataLength, sizeof( entry._dataLength ) );
-		outputFile.write( (const char*)&entry._dataPadLength, sizeof( entry._dataPadLength ) );
-		outputFile.write( (const char*)&entry._data[0], entry._dataLength );
+//Stored and original lengths only differ for compressed entries and references
+static bool validDataLengths( unsigned char flags, uint64_t dataLength, unsigned short dataPadLength, uint64_t originalLength ) {
+	if ( dataPadLength > dataLength ) {
+		return false;
 	}
-	char endOfFile[4];
-	memset( endOfFile, 0xFF, sizeof( endOfFile ) );
-	outputFile.write( endOfFile, sizeof( endOfFile ) );  //Write end of data byte sequence
-	outputFile.close();
-}
\ No newline at end of file
+	else if ( flags & referenceFlag ) {
+		return !(flags & (compressedFlag | solidFlag)) && dataLength - dataPadLength == sizeof( uint32_t );
+	}
+	return flags & compressedFlag || originalLength == dataLength - dataPadLength;
+}
+
+//Reads the header of the entry at the current position, leaving the source at the start of its data
+//dataLength is set to the length of the data as stored, padding included, while the entry reports its original length
+//v9 headers don't have the stored length, padding length or checksum, which are left at 0 until the data is read
+//Sets endOfFile instead when the end of data byte sequence is found
+static int readEntryHeader( EntrySource& source, unsigned char versionByte, const KeyContext& key, bool verboseLogging, FeD_Entry& entry, size_t& dataLength, bool& endOfFile ) {
+	endOfFile = false;
+
+	//Read index
+	unsigned int index;
+	if ( !readValue( source, index ) ) {
+		printf( "Error: Unexpected end of file\n" );
+		return 1;
+	}
+	entry.setIndex( index );
+
+	if ( entry.index() == 0xFFFFFFFF ) {
+		if ( verboseLogging ) printf( "End of file found\n" );
+		endOfFile = true;
+		return 0;
+	}
+
+	//Read initialization vector
+	const char* data = source.read( initVectorSize );
+	if ( data == nullptr ) {
+		printf( "Error: Unexpected end of file\n" );
+		return 1;
+	}
+	entry.setInitVector( data );
+
+	//Read path size
+	unsigned short pathLength = 0;
+	readValue( source, pathLength );
+
+	//Read path padding size
+	unsigned short pathPadLength = 0;
+	readValue( source, pathPadLength );
+
+	//Read path
+	if ( pathLength > pathMaxSize || pathPadLength > pathLength ) {
+		printf( "Error: Entry %u has an invalid path length\n", entry.index() );
+		return 1;
+	}
+	data = source.read( pathLength );
+	if ( data == nullptr ) {
+		printf( "Error: Unexpected end of file\n" );
+		return 1;
+	}
+	std::string buffer( data, pathLength );
+	decryptPath( buffer, key, entry.initVector(), versionByte );
+	buffer.resize( buffer.size()-pathPadLength );
+	entry.setPath( &buffer[0], buffer.size() );
+
+	//Read data length and padding size
+	dataLength = 0;
+	unsigned short dataPadLength = 0;
+	bool validHeader = true;
+	if ( versionByte < 0x09 ) {
+		validHeader = readValue( source, dataLength ) && readValue( source, dataPadLength );
+	}
+
+	//Read flags and original length
+	unsigned char flags = 0;
+	uint64_t originalLength = dataLength - dataPadLength;
+	if ( versionByte >= 0x07 ) {
+		validHeader = readValue( source, flags ) && readValue( source, originalLength ) && validHeader;
+	}
+
+	//Read checksum
+	unsigned int checksum = 0;
+	if ( versionByte == 0x08 ) {
+		validHeader = readValue( source, checksum ) && validHeader;
+	}
+	if ( !validHeader || (versionByte < 0x09 && !validDataLengths( flags, dataLength, dataPadLength, originalLength )) ) {
+		printf( "Error: Entry %u has an invalid header\n", entry.index() );
+		return 1;
+	}
+	entry.setDataLength( (size_t)originalLength );
+	entry.setDataPadLength( dataPadLength );
+	entry.setFlags( flags );
+	entry.setOriginalLength( originalLength );
+	entry.setChecksum( checksum );
+	//One line for the whole header, a line for every field made small entries slower to read than to decrypt
+	if ( verboseLogging ) {
+		printf( "%.3u: Header read, %llu bytes, flags %.2X\n", entry.index(), (unsigned long long)originalLength, flags );
+	}
+	return 0;
+}
+
+//Decrypts the data of stored, which starts at the current position, and passes it to the visitor as the data of entry
+//Compressed data is decompressed on the way, one block at a time, and v8 data is checked against its checksum once it's all through
+//v9 data is read one frame at a time, the last of which says how much of it is padding, so dataLength isn't needed
+static int readEntryData( EntrySource& source, unsigned char versionByte, const KeyContext& key, const FeD_Entry& stored, size_t dataLength,
+	FeD_EntryVisitor& visitor, const FeD_Entry& entry, std::vector<char>& dataBuffer ) {
+	bool compressed = stored.flags() & compressedFlag;
+	BlockDecompressor decompressor;
+	uint32_t checksum = 0;
+	//Made into a function once, instead of once per block when it's handed to the decompressor
+	std::function<void( const char*, size_t )> passOn = [&]( const char* data, size_t length ) {
+		checksum = crc32c( checksum, data, length );
+		countBytes( length );
+		visitor.entryData( entry, data, length );
+	};
+	CBCDecryptStream cipher( key, stored.initVector(), versionByte );
+	//Decrypts the next length bytes, of which only the first usedLength are passed on
+	auto decode = [&]( size_t length, size_t usedLength ) {
+		source.willRead( length );
+		size_t position = 0;
+		while ( position < length ) {
+			size_t chunkLength = std::min( length - position, dataBuffer.size() );
+			const char* data;
+			{
+				PhaseTimer timer( Phase::Read );
+				data = source.read( chunkLength );
+			}
+			if ( data == nullptr ) {
+				printf( "Error: Unexpected end of file\n" );
+				return 1;
+			}
+			{
+				PhaseTimer timer( Phase::Cipher );
+				cipher.update( data, &dataBuffer[0], chunkLength );
+			}
+			if ( position < usedLength ) {
+				size_t passLength = std::min( chunkLength, usedLength - position );
+				if ( !compressed ) {
+					passOn( &dataBuffer[0], passLength );
+				}
+				else {
+					//Includes whatever the visitor does with the decompressed data, writing it out included
+					PhaseTimer timer( Phase::Compression );
+					if ( decompressor.update( &dataBuffer[0], passLength, passOn ) != 0 ) {
+						return 1;
+					}
+				}
+			}
+			position += chunkLength;
+		}
+		return 0;
+	};
+
+	unsigned int storedChecksum = stored.checksum();
+	if ( versionByte < 0x09 ) {
+		if ( decode( dataLength, dataLength - stored.dataPadLength() ) != 0 ) {
+			return 1;
+		}
+	}
+	else {
+		bool lastFrame = false;
+		while ( !lastFrame ) {
+			uint32_t frameHeader;
+			unsigned short dataPadLength = 0;
+			if ( !readValue( source, frameHeader ) ) {
+				printf( "Error: Unexpected end of file\n" );
+				return 1;
+			}
+			lastFrame = (frameHeader & lastFrameFlag) != 0;
+			size_t frameLength = frameHeader & ~lastFrameFlag;
+			if ( lastFrame && !readValue( source, dataPadLength ) ) {
+				printf( "Error: Unexpected end of file\n" );
+				return 1;
+			}
+			if ( dataPadLength > frameLength || dataPadLength >= blockSize ) {
+				printf( "Error: Entry %u has an invalid padding length\n", stored.index() );
+				return 1;
+			}
+			if ( decode( frameLength, frameLength - dataPadLength ) != 0 ) {
+				return 1;
+			}
+		}
+		if ( !readValue( source, storedChecksum ) ) {
+			printf( "Error: Unexpected end of file\n" );
+			return 1;
+		}
+	}
+	if ( compressed && (decompressor.finish() != 0 || decompressor.totalLength() != stored.dataLength()) ) {
+		printf( "Error: Entry %u does not decompress to its original length\n", stored.index() );
+		return 1;
+	}
+	//References have no checksum of their own
+	if ( versionByte >= 0x08 && !(stored.flags() & referenceFlag) && checksum != storedChecksum ) {
+		printf( "Error: Entry %u does not match its checksum, the file is damaged or the key is wrong\n", stored.index() );
+		return 1;
+	}
+	return 0;
+}
+
+//Moves the source past the data of the entry whose header was just read, without decrypting any of it
+static bool skipEntryData( EntrySource& source, unsigned char versionByte, size_t dataLength ) {
+	if ( versionByte < 0x09 ) {
+		return source.seek( source.position() + dataLength );
+	}
+	while ( true ) {
+		uint32_t frameHeader;
+		if ( !readValue( source, frameHeader ) ) {
+			return false;
+		}
+		uint64_t frameLength = frameHeader & ~lastFrameFlag;
+		if ( frameHeader & lastFrameFlag ) {
+			frameLength += sizeof( unsigned short ) + checksumSize;
+		}
+		if ( !source.seek( source.position() + frameLength ) ) {
+			return false;
+		}
+		if ( frameHeader & lastFrameFlag ) {
+			return true;
+		}
+	}
+}
+
+namespace {
+	//Gathers a whole entry's data in memory, for references and solid blocks which have to be taken apart once they're decoded
+	class EntryBuffer : public FeD_EntryVisitor {
+	public:
+		EntryBuffer( std::string& data ) : _data( data ) {};
+
+		void beginEntry( const FeD_Entry& ) override {};
+		void entryData( const FeD_Entry&, const char* data, size_t length ) override { _data.append( data, length ); };
+		void endEntry( const FeD_Entry& ) override {};
+
+	private:
+		std::string& _data;
+	};
+}
+
+//Reads and decrypts the data of a reference, which is the index of the entry it refers to
+static int readReferenceIndex( EntrySource& source, unsigned char versionByte, const KeyContext& key, const FeD_Entry& entry, size_t dataLength,
+	std::vector<char>& dataBuffer, unsigned int& targetIndex ) {
+	std::string reference;
+	if ( versionByte >= 0x09 ) {
+		EntryBuffer buffer( reference );
+		if ( readEntryData( source, versionByte, key, entry, dataLength, buffer, entry, dataBuffer ) != 0 ) {
+			return 1;
+		}
+	}
+	else {
+		const char* data = source.read( dataLength );
+		if ( data == nullptr ) {
+			printf( "Error: Unexpected end of file\n" );
+			return 1;
+		}
+		reference.assign( data, dataLength );
+		CBCDecrypt( reference, key, entry.initVector(), versionByte );
+	}
+	if ( reference.size() < sizeof( targetIndex ) ) {
+		printf( "Error: Entry %u has an invalid header\n", entry.index() );
+		return 1;
+	}
+	memcpy( &targetIndex, &reference[0], sizeof( targetIndex ) );
+	return 0;
+}
+
+void FileDeen::writeSolidTable( const std::vector<FeD_SolidMember>& members, std::string& data ) {
+	auto append = [&]( const auto& value ) {
+		data.append( (const char*)&value, sizeof( value ) );
+	};
+	append( (uint32_t)members.size() );
+	for ( const auto& member : members ) {
+		append( (uint32_t)member.index );
+		append( member.dataLength );
+		append( (uint16_t)member.path.size() );
+		data.append( member.path );
+	}
+}
+
+//Largest a solid block can decode to, anything larger is damaged
+const uint64_t solidBlockMaxLength = solidBlockSize*2 + solidBlockMembers*(solidMemberSize+pathMaxSize) + sizeof( uint32_t );
+
+//Turns the member table at the start of a decoded solid block into entries, checking that their data fits in the block
+static int readSolidTable( const FeD_Entry& block, const std::string& data, std::vector<FeD_Entry>& members, size_t& dataPosition ) {
+	size_t position = 0;
+	auto read = [&]( auto& value ) {
+		if ( data.size() - position < sizeof( value ) ) {
+			return false;
+		}
+		memcpy( &value, &data[position], sizeof( value ) );
+		position += sizeof( value );
+		return true;
+	};
+	uint32_t memberCount = 0;
+	bool validTable = read( memberCount ) && memberCount <= solidBlockMembers;
+	uint64_t totalLength = 0;
+	members.clear();
+	for ( uint32_t i = 0; validTable && i < memberCount; i++ ) {
+		uint32_t index, dataLength;
+		uint16_t pathLength;
+		validTable = read( index ) && read( dataLength ) && read( pathLength ) && pathLength <= pathMaxSize && data.size() - position >= pathLength;
+		if ( validTable ) {
+			FeD_Entry member;
+			member.setIndex( index );
+			member.setPath( (char*)&data[position], pathLength );
+			member.setDataLength( dataLength );
+			member.setOriginalLength( dataLength );
+			members.push_back( std::move( member ) );
+			position += pathLength;
+			totalLength += dataLength;
+		}
+	}
+	if ( !validTable || totalLength != data.size() - position ) {
+		printf( "Error: Solid block %u has an invalid member table\n", block.index() );
+		return 1;
+	}
+	dataPosition = position;
+	return 0;
+}
+
+//Decodes a solid block whose data starts at the current position, and splits it into its members
+static int readSolidBlock( EntrySource& source, unsigned char versionByte, const KeyContext& key, const FeD_Entry& block, size_t dataLength,
+	std::vector<char>& dataBuffer, std::string& data, std::vector<FeD_Entry>& members, size_t& dataPosition ) {
+	if ( block.dataLength() > solidBlockMaxLength ) {
+		printf( "Error: Solid block %u is too large\n", block.index() );
+		return 1;
+	}
+	data.clear();
+	data.reserve( block.dataLength() );
+	EntryBuffer buffer( data );
+	if ( readEntryData( source, versionByte, key, block, dataLength, buffer, block, dataBuffer ) != 0 ) {
+		return 1;
+	}
+	return readSolidTable( block, data, members, dataPosition );
+}
+
+//Finds the source and header offset of an earlier entry by its index, for entries that are references to it
+//Returns nullptr if there's no such entry, the source is the one being read unless the entry is in another volume
+typedef std::function<EntrySource*( unsigned int index, uint64_t& offset )> EntryLocator;
+
+//Reads the entry at the current position and passes it to the visitor, decrypting its data one buffer at a time
+//The data of a reference is read from the entry it points to, after which the source is left past the reference
+//Sets endOfFile instead when the end of data byte sequence is found
+static int readEntry( EntrySource& source, unsigned char versionByte, const KeyContext& key, bool verboseLogging, const EntryLocator& locateEntry,
+	FeD_EntryVisitor& visitor, std::vector<char>& dataBuffer, bool& endOfFile ) {
+	FileDeen::FeD_Entry entry;
+	size_t dataLength;
+	if ( readEntryHeader( source, versionByte, key, verboseLogging, entry, dataLength, endOfFile ) != 0 || endOfFile ) {
+		return endOfFile ? 0 : 1;
+	}
+
+	if ( entry.flags() & solidFlag ) {
+		//Every member is passed on as an entry of its own, in pieces no larger than the buffer like any other entry
+		if ( verboseLogging ) printf( "%.3u: Reading solid block...\n", entry.index() );
+		std::string data;
+		std::vector<FeD_Entry> members;
+		size_t position;
+		if ( readSolidBlock( source, versionByte, key, entry, dataLength, dataBuffer, data, members, position ) != 0 ) {
+			return 1;
+		}
+		for ( auto& member : members ) {
+			if ( !visitor.wantsEntry( member ) ) {
+				position += member.dataLength();
+				continue;
+			}
+			member.setChecksum( crc32c( 0, &data[position], member.dataLength() ) );
+			visitor.beginEntry( member );
+			for ( size_t offset = 0; offset < member.dataLength(); offset += dataBuffer.size() ) {
+				visitor.entryData( member, &data[position+offset], std::min( member.dataLength() - offset, dataBuffer.size() ) );
+			}
+			visitor.endEntry( member );
+			countEntry();
+			countBytes( member.dataLength() );
+			position += member.dataLength();
+		}
+		return 0;
+	}
+	else if ( !visitor.wantsEntry( entry ) ) {
+		if ( verboseLogging ) printf( "%.3u: Skipping...\n", entry.index() );
+		if ( !skipEntryData( source, versionByte, dataLength ) ) {
+			printf( "Error: Unexpected end of file\n" );
+			return 1;
+		}
+		return 0;
+	}
+	else if ( !(entry.flags() & referenceFlag) ) {
+		if ( verboseLogging ) printf( "%.3u: Reading data...\n", entry.index() );
+		visitor.beginEntry( entry );
+		if ( readEntryData( source, versionByte, key, entry, dataLength, visitor, entry, dataBuffer ) != 0 ) {
+			return 1;
+		}
+		visitor.endEntry( entry );
+		countEntry();
+		return 0;
+	}
+
+	//Read the referenced entry's data in place of its own
+	unsigned int targetIndex;
+	if ( readReferenceIndex( source, versionByte, key, entry, dataLength, dataBuffer, targetIndex ) != 0 ) {
+		return 1;
+	}
+	if ( verboseLogging ) printf( "%.3u: Reading data of entry %.3u...\n", entry.index(), targetIndex );
+	uint64_t nextEntry = source.position(), targetOffset;
+	FileDeen::FeD_Entry target;
+	size_t targetLength;
+	bool targetEnd = false;
+	EntrySource* targetSource = locateEntry( targetIndex, targetOffset );
+	if ( targetSource == nullptr || !targetSource->seek( targetOffset ) ||
+		readEntryHeader( *targetSource, versionByte, key, false, target, targetLength, targetEnd ) != 0 || targetEnd ||
+		target.index() != targetIndex || target.flags() & (referenceFlag | solidFlag) || target.dataLength() != entry.dataLength() ) {
+		printf( "Error: Entry %u refers to entry %u, which is missing or invalid\n", entry.index(), targetIndex );
+		return 1;
+	}
+	visitor.beginEntry( entry );
+	if ( readEntryData( *targetSource, versionByte, key, target, targetLength, visitor, entry, dataBuffer ) != 0 ) {
+		return 1;
+	}
+	visitor.endEntry( entry );
+	countEntry();
+	if ( !source.seek( nextEntry ) ) {
+		printf( "Error: Unexpected end of file\n" );
+		return 1;
+	}
+	return 0;
+}
+
+//Streaming read, entries are handed to the visitor as they are decrypted instead of being stored
+//At most bufferSize bytes of entry data are held in memory at once
+int FeD::readFromFile( std::filesystem::path fileName, std::string key, bool verboseLogging, FeD_EntryVisitor& visitor, size_t bufferSize ) {
+	return this->readFromFile( fileName, KeyContext( key ), verboseLogging, visitor, bufferSize );
+}
+
+//Reads every entry from the current position up to the end of data byte sequence
+//References are resolved through locateEntry, which is told the offset of every entry as it's reached
+static int readEntries( EntrySource& source, unsigned char versionByte, const KeyContext& key, bool verboseLogging,
+	std::unordered_map<unsigned int, uint64_t>& entryOffsets, const EntryLocator& locateEntry, FeD_EntryVisitor& visitor, size_t bufferSize ) {
+	std::vector<char> dataBuffer( bufferSize > 0 ? bufferSize : defaultStreamBufferSize );
+	bool endOfFile = false;
+	while ( !endOfFile ) {
+		const char* index = source.peek( indexSize );
+		if ( index != nullptr ) {
+			unsigned int entryIndex;
+			memcpy( &entryIndex, index, sizeof( entryIndex ) );
+			entryOffsets.emplace( entryIndex, source.position() );
+		}
+		if ( readEntry( source, versionByte, key, verboseLogging, locateEntry, visitor, dataBuffer, endOfFile ) != 0 ) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int FeD::readFromFile( std::filesystem::path fileName, const KeyContext& key, bool verboseLogging, FeD_EntryVisitor& visitor, size_t bufferSize ) {
+	std::unique_ptr<EntrySource> source = openEntrySource( fileName );
+	if ( source == nullptr ) {
+		return 1;
+	}
+	unsigned char versionByte;
+	if ( readPreamble( *source, verboseLogging, _signature, versionByte ) != 0 ) {
+		return 1;
+	}
+
+	//Entries are stored back to back in every version, so a trailing directory can simply be ignored here
+	//References only ever point back, so the offsets of the entries read so far are enough to resolve them
+	std::unordered_map<unsigned int, uint64_t> entryOffsets;
+	auto locateEntry = [&]( unsigned int index, uint64_t& offset ) -> EntrySource* {
+		auto found = entryOffsets.find( index );
+		if ( found == entryOffsets.end() ) {
+			return nullptr;
+		}
+		offset = found->second;
+		return source.get();
+	};
+	return readEntries( *source, versionByte, key, verboseLogging, entryOffsets, locateEntry, visitor, bufferSize );
+}
+
+//Same as reading a file, except that the entries a reference points to have already gone by, so references can't be read
+int FeD::readFromInput( const KeyContext& key, bool verboseLogging, FeD_EntryVisitor& visitor, size_t bufferSize ) {
+	InputSource source;
+	unsigned char versionByte;
+	if ( readPreamble( source, verboseLogging, _signature, versionByte ) != 0 ) {
+		return 1;
+	}
+	std::unordered_map<unsigned int, uint64_t> entryOffsets;
+	auto locateEntry = [&]( unsigned int, uint64_t& ) -> EntrySource* {
+		printf( "Error: References to earlier entries can't be read from standard input\n" );
+		return nullptr;
+	};
+	return readEntries( source, versionByte, key, verboseLogging, entryOffsets, locateEntry, visitor, bufferSize );
+}
+
+//Write FeD class to file
+void FeD::writeToFile( std::filesystem::path fileName ) {
+	FeD_Writer writer;
+	if ( writer.open( fileName, _signature ) != 0 ) {
+		return;
+	}
+	for ( const auto& entry : _entries ) {  //Iterate through entry vector and write each in sequence
+		writer.writeHeader( entry );
+		writer.writeData( &entry._data[0], entry._dataLength );
+		writer.finishEntry( entry._dataPadLength, entry._checksum );
+	}
+	writer.close();
+}
+
+
+
+static int readDirectory( EntrySource& source, unsigned char versionByte, bool verboseLogging, std::vector<FeD_DirectoryEntry>& directory );
+
+FeD_Writer::FeD_Writer( size_t bufferSize ) : _buffer( bufferSize > 0 ? bufferSize : defaultStreamBufferSize ), _compress( false ), _failed( false ), _volumeOverrun( false ), _nextIndex( 0 ),
+	_volumeSize( 0 ), _volumeSet( 0 ), _lane( 0 ) {
+}
+
+void FeD_Writer::setVolumes( uint64_t volumeSize, const std::vector<std::filesystem::path>& folders ) {
+	_volumeSize = volumeSize;
+	_volumeFolders = folders;
+}
+
+int FeD_Writer::open( std::filesystem::path fileName, std::string signature ) {
+	_signature = signature;
+	_failed = _volumeOverrun = false;
+	_nextIndex = 0;
+	_volumes.clear();
+	_lanes.clear();
+	_lane = 0;
+	_frame.clear();
+	std::vector<std::filesystem::path> folders = { fileName.parent_path() };
+	if ( _volumeSize > 0 ) {
+		folders.insert( folders.end(), _volumeFolders.begin(), _volumeFolders.end() );
+		_volumeSet = ((uint64_t)time( NULL ) << 32) ^ std::random_device()();
+		//Extra folders are created like the folders entries are decoded into, failing to is reported once the volume can't be opened
+		for ( const auto& folder : _volumeFolders ) {
+			std::error_code error;
+			std::filesystem::create_directories( folder, error );
+		}
+	}
+	for ( const auto& folder : folders ) {
+		Lane lane;
+		lane.folder = folder;
+		lane.outputFile.reset( new AsyncFileWriter() );
+		lane.written = 0;
+		_lanes.push_back( std::move( lane ) );
+	}
+	for ( auto& lane : _lanes ) {
+		this->openVolume( lane, _volumeSize > 0 ? volumePath( lane.folder, fileName.filename(), (unsigned int)_volumes.size() + 1 ) : fileName );
+	}
+	return _failed ? 1 : 0;
+}
+
+int FeD_Writer::open( AsyncFileHandle output, std::string signature ) {
+	if ( _volumeSize > 0 ) {
+		printf( "Error: FeD files written to a stream can't be split into volumes\n" );
+		return 1;
+	}
+	_signature = signature;
+	_failed = false;
+	_nextIndex = 0;
+	_volumes.clear();
+	_lanes.clear();
+	_lane = 0;
+	_frame.clear();
+	Lane lane;
+	lane.outputFile.reset( new AsyncFileWriter() );
+	lane.written = 0;
+	if ( !lane.outputFile->open( output ) ) {
+		printf( "Error: Could not open the stream to write to\n" );
+		_failed = true;
+	}
+	_lanes.push_back( std::move( lane ) );
+	this->startVolume( _lanes[0], std::filesystem::path() );
+	return _failed ? 1 : 0;
+}
+
+void FeD_Writer::openVolume( Lane& lane, std::filesystem::path fileName ) {
+	if ( !lane.outputFile->open( fileName ) ) {
+		printf( "Error: Could not open \'%s\' for writing\n", fileName.u8string().c_str() );
+		_failed = true;
+	}
+	this->startVolume( lane, fileName );
+}
+
+//Every volume starts out like a whole file would, with the signature and version
+void FeD_Writer::startVolume( Lane& lane, std::filesystem::path fileName ) {
+	Volume volume;
+	volume.path = fileName;
+	volume.position = _signature.size() + versionSize;
+	volume.directoryLength = 0;
+	lane.outputFile->write( &_signature[0], _signature.size() );  //Write signature
+	lane.outputFile->write( (const char*)&formatVersion, versionSize );  //Put version byte
+	lane.volume = _volumes.size();
+	_volumes.push_back( std::move( volume ) );
+}
+
+//The end of data byte sequence sits right before the directory, so finding it only takes reading the directory
+//New entries are written over both, and close() writes them back out with the new entries added
+//A file left unclosed loses its directory and every entry after the last one written, like a file being encoded would
+int FeD_Writer::openForAppend( std::filesystem::path fileName ) {
+	std::unique_ptr<EntrySource> source = openEntrySource( fileName, false );
+	if ( source == nullptr ) {
+		return 1;
+	}
+	const char* preamble = source->read( metadataSize );
+	if ( preamble == nullptr || memcmp( preamble, SIGN, signSize ) != 0 ) {
+		printf( "Error: \'%s\' is not a FeD file\n", fileName.u8string().c_str() );
+		return 1;
+	}
+	unsigned char versionByte = preamble[signSize];
+	if ( versionByte != formatVersion ) {
+		printf( "Error: Only \'v%u\' FeD files can be appended to, \'%s\' is \'v%u\'\n", formatVersion, fileName.u8string().c_str(), versionByte );
+		return 1;
+	}
+	VolumeInfo volumeInfo;
+	if ( readVolumeInfo( *source, volumeInfo ) ) {
+		printf( "Error: \'%s\' is a volume of a FeD file split into volumes, which can't be appended to\n", fileName.u8string().c_str() );
+		return 1;
+	}
+
+	std::vector<FeD_DirectoryEntry> directory;
+	if ( readDirectory( *source, versionByte, false, directory ) != 0 ) {
+		return 1;
+	}
+	uint64_t directoryOffset = 0;
+	const char* endOfFile = nullptr;
+	if ( source->seek( source->size() - directoryFooterSize ) && readValue( *source, directoryOffset ) &&
+		directoryOffset >= (uint64_t)metadataSize + indexSize && source->seek( directoryOffset - indexSize ) ) {
+		endOfFile = source->read( indexSize );
+	}
+	if ( endOfFile == nullptr || memcmp( endOfFile, "\xFF\xFF\xFF\xFF", indexSize ) != 0 ) {
+		printf( "Error: \'%s\' has no end of data byte sequence before its directory\n", fileName.u8string().c_str() );
+		return 1;
+	}
+	source.reset();
+
+	Lane lane;
+	lane.outputFile.reset( new AsyncFileWriter() );
+	if ( !lane.outputFile->open( fileName, false ) ) {
+		printf( "Error: Could not open \'%s\' for writing\n", fileName.u8string().c_str() );
+		return 1;
+	}
+	Volume volume;
+	volume.path = fileName;
+	volume.position = directoryOffset - indexSize;
+	volume.directoryLength = 0;
+	lane.outputFile->seek( volume.position );
+	lane.volume = 0;
+	lane.written = 0;
+	_nextIndex = 0;
+	for ( const auto& record : directory ) {
+		_nextIndex = std::max( _nextIndex, record.index + 1 );
+	}
+	volume.directory = std::move( directory );
+	_volumes.clear();
+	_volumes.push_back( std::move( volume ) );
+	_lanes.clear();
+	_lanes.push_back( std::move( lane ) );
+	_lane = 0;
+	_volumeSize = 0;
+	_failed = false;
+	_frame.clear();
+	return 0;
+}
+
+//Entry should already have its index, initialization vector and encrypted path set
+int FeD_Writer::writeEntry( FeD_Entry& entry, std::filesystem::path sourceFile, std::string key ) {
+	return this->writeEntry( entry, sourceFile, KeyContext( key ) );
+}
+
+int FeD_Writer::writeEntry( FeD_Entry& entry, std::filesystem::path sourceFile, const KeyContext& key ) {
+	//Readers refuse headers with longer paths, and can't find the entries after one either
+	if ( entry._pathLength > pathMaxSize ) {
+		printf( "Error: Path of \'%s\' is too long to be stored\n", sourceFile.u8string().c_str() );
+		return 1;
+	}
+	std::fstream inputFile( sourceFile, std::ios::in | std::ios::binary | std::ios::ate );
+	if ( !inputFile ) {
+		printf( "Error: Could not open \'%s\'\n", sourceFile.u8string().c_str() );
+		return 1;
+	}
+	size_t length = inputFile.tellg();
+	inputFile.seekg( 0 );
+
+	if ( _compress ) {
+		size_t sampleLength = std::min( { length, compressionProbeSize, _buffer.size() } );
+		inputFile.read( &_buffer[0], sampleLength );
+		inputFile.seekg( 0 );
+		if ( (size_t)inputFile.gcount() == sampleLength && isCompressible( &_buffer[0], sampleLength ) ) {
+			return this->writeCompressedEntry( entry, inputFile, length, sourceFile, key );
+		}
+	}
+
+	//Padding length is known from the file size alone, the checksum follows the data once it's all been read
+	entry._dataPadLength = CBCEncryptStream::paddingLength( length );
+	entry._dataLength = length + entry._dataPadLength;
+	this->writeHeader( entry );
+
+	CBCEncryptStream cipher( key, entry._initVector );
+	int result = 0;
+	uint32_t checksum = 0;
+	size_t remaining = length;
+	while ( remaining > 0 ) {
+		size_t chunkLength = std::min( remaining, _buffer.size() );
+		inputFile.read( &_buffer[0], chunkLength );
+		if ( (size_t)inputFile.gcount() < chunkLength ) {
+			//File shrank while being read, fill out the length already promised in the header
+			memset( &_buffer[inputFile.gcount()], 0x00, chunkLength - inputFile.gcount() );
+			if ( result == 0 ) {
+				printf( "Error: \'%s\' changed while being read\n", sourceFile.u8string().c_str() );
+			}
+			result = 1;
+		}
+		checksum = crc32c( checksum, &_buffer[0], chunkLength );
+		cipher.update( &_buffer[0], chunkLength );
+		this->writeData( &_buffer[0], chunkLength );
+		remaining -= chunkLength;
+	}
+	inputFile.close();
+
+	std::vector<char> padding( entry._dataPadLength, cipher.paddingByte() );
+	if ( padding.size() > 0 ) {
+		cipher.update( &padding[0], padding.size() );
+		this->writeData( &padding[0], padding.size() );
+	}
+	entry._checksum = checksum;
+	this->finishEntry( entry._dataPadLength, checksum );
+	return result;
+}
+
+//Stored length isn't known until the whole entry is compressed, it's only recorded in the directory once the last frame is written
+int FeD_Writer::writeCompressedEntry( FeD_Entry& entry, std::fstream& inputFile, size_t length, std::filesystem::path sourceFile, const KeyContext& key ) {
+	entry._flags |= compressedFlag;
+	entry._originalLength = length;
+	entry._dataLength = 0;
+	entry._dataPadLength = 0;
+	this->writeHeader( entry );
+
+	CBCEncryptStream cipher( key, entry._initVector );
+	BlockCompressor compressor;
+	std::vector<char> compressed;
+	uint64_t storedLength = 0;
+	auto writeCompressed = [&]() {
+		if ( !compressed.empty() ) {
+			cipher.update( &compressed[0], compressed.size() );
+			this->writeData( &compressed[0], compressed.size() );
+			storedLength += compressed.size();
+			compressed.clear();
+		}
+	};
+
+	int result = 0;
+	uint32_t checksum = 0;
+	size_t remaining = length;
+	while ( remaining > 0 ) {
+		size_t chunkLength = std::min( remaining, _buffer.size() );
+		inputFile.read( &_buffer[0], chunkLength );
+		if ( (size_t)inputFile.gcount() < chunkLength ) {
+			//File shrank while being read, fill out the length already recorded as the original length
+			memset( &_buffer[inputFile.gcount()], 0x00, chunkLength - inputFile.gcount() );
+			if ( result == 0 ) {
+				printf( "Error: \'%s\' changed while being read\n", sourceFile.u8string().c_str() );
+			}
+			result = 1;
+		}
+		checksum = crc32c( checksum, &_buffer[0], chunkLength );
+		compressor.update( &_buffer[0], chunkLength, compressed );
+		writeCompressed();
+		remaining -= chunkLength;
+	}
+	inputFile.close();
+	compressor.finish( compressed );
+	writeCompressed();
+
+	unsigned short dataPadLength = CBCEncryptStream::paddingLength( (size_t)storedLength );
+	std::vector<char> padding( dataPadLength, cipher.paddingByte() );
+	if ( padding.size() > 0 ) {
+		cipher.update( &padding[0], padding.size() );
+		this->writeData( &padding[0], padding.size() );
+	}
+	entry._dataLength = (size_t)storedLength + dataPadLength;
+	entry._dataPadLength = dataPadLength;
+	entry._checksum = checksum;
+	this->finishEntry( dataPadLength, checksum );
+	return result;
+}
+
+//Entries are spread over the lanes of a file split into volumes by how much each lane has been given so far
+//A volume is closed off once the entry wouldn't fit in it along with its directory, which are only written by close()
+void FeD_Writer::writeHeader( const FeD_Entry& entry ) {
+	PhaseTimer timer( Phase::Write );
+	const size_t headerLength = indexSize + initVectorSize + paddingLengthSize + entry._pathLength + entryFlagsSize,
+		recordLength = directoryRecordMinSize + entry._pathLength + entryFlagsSize + checksumSize;
+	if ( _volumeSize > 0 ) {
+		_lane = 0;
+		for ( size_t i = 1; i < _lanes.size(); i++ ) {
+			if ( _lanes[i].written < _lanes[_lane].written ) {
+				_lane = i;
+			}
+		}
+		//Stored length of compressed entries is only known once they're written, their blocks are never stored any larger than the original plus a block header
+		uint64_t storedLength = entry._dataLength;
+		if ( entry._flags & compressedFlag ) {
+			uint64_t blockCount = (entry._originalLength + compressionBlockSize - 1) / compressionBlockSize;
+			storedLength = std::max<uint64_t>( storedLength, entry._originalLength + blockCount*compressionBlockHeaderSize + blockSize );
+		}
+		storedLength += (storedLength / entryFrameSize + 1)*frameHeaderSize + sizeof( entry._dataPadLength ) + checksumSize;
+		Lane& lane = _lanes[_lane];
+		auto fits = [&]( const Volume& volume ) {
+			return volume.position + headerLength + storedLength + indexSize + volume.directoryLength + recordLength + volumeInfoSize + directoryFooterSize <= _volumeSize;
+		};
+		if ( !_volumes[lane.volume].directory.empty() && !fits( _volumes[lane.volume] ) ) {
+			char endOfFile[4];
+			memset( endOfFile, 0xFF, sizeof( endOfFile ) );
+			lane.outputFile->write( endOfFile, sizeof( endOfFile ) );  //Write end of data byte sequence
+			_volumes[lane.volume].position += sizeof( endOfFile );
+			lane.outputFile->close();
+			this->openVolume( lane, volumePath( lane.folder, _volumes[0].path.stem(), (unsigned int)_volumes.size() + 1 ) );
+		}
+		//Still written, so nothing is lost, but the volume size was meant as a limit, so it counts as a failure
+		if ( !fits( _volumes[lane.volume] ) ) {
+			printf( "Error: Entry %u does not fit in a volume, volume %u will be larger than the volume size\n", entry._index, (unsigned int)lane.volume + 1 );
+			_volumeOverrun = true;
+		}
+	}
+	Lane& lane = _lanes[_lane];
+	Volume& volume = _volumes[lane.volume];
+
+	FeD_DirectoryEntry record;
+	record.offset = volume.position;
+	record.index = entry._index;
+	record.initVector = entry._initVector;
+	record.pathLength = entry._pathLength;
+	record.pathPadLength = entry._pathPadLength;
+	record.path.assign( (const char*)&entry._path[0], entry._pathLength );
+	record.dataLength = 0;
+	record.dataPadLength = 0;
+	record.flags = entry._flags;
+	record.originalLength = entry._flags & (compressedFlag | referenceFlag) ? entry._originalLength : entry._dataLength - entry._dataPadLength;
+	record.checksum = entry._checksum;
+	record.volume = (unsigned int)lane.volume;
+	volume.directory.push_back( std::move( record ) );
+	volume.directoryLength += recordLength;
+
+	_header.clear();
+	entry.writeHeader( _header );
+	lane.outputFile->write( &_header[0], _header.size() );
+	volume.position += headerLength;
+	lane.written += headerLength;
+}
+
+//Full frames go out straight from data, only the start of the next one is copied aside until the rest of it comes in
+void FeD_Writer::writeData( const char* data, size_t length ) {
+	PhaseTimer timer( Phase::Write );
+	while ( _frame.size() + length > entryFrameSize + blockSize ) {
+		if ( _frame.empty() ) {
+			this->writeFrame( data, entryFrameSize, false, 0 );
+			data += entryFrameSize;
+			length -= entryFrameSize;
+		}
+		else if ( _frame.size() >= entryFrameSize ) {
+			this->writeFrame( &_frame[0], entryFrameSize, false, 0 );
+			_frame.erase( _frame.begin(), _frame.begin() + entryFrameSize );
+		}
+		else {
+			size_t fillLength = entryFrameSize - _frame.size();
+			_frame.insert( _frame.end(), data, data + fillLength );
+			data += fillLength;
+			length -= fillLength;
+			this->writeFrame( &_frame[0], _frame.size(), false, 0 );
+			_frame.clear();
+		}
+	}
+	_frame.insert( _frame.end(), data, data + length );
+}
+
+void FeD_Writer::finishEntry( unsigned short dataPadLength, unsigned int checksum ) {
+	PhaseTimer timer( Phase::Write );
+	this->writeFrame( _frame.data(), _frame.size(), true, dataPadLength );
+	_frame.clear();
+
+	Lane& lane = _lanes[_lane];
+	lane.outputFile->write( (const char*)&checksum, sizeof( checksum ) );
+	_volumes[lane.volume].position += sizeof( checksum );
+	lane.written += sizeof( checksum );
+	FeD_DirectoryEntry& record = _volumes[lane.volume].directory.back();
+	record.dataPadLength = dataPadLength;
+	record.checksum = checksum;
+}
+
+void FeD_Writer::writeFrame( const char* data, size_t length, bool lastFrame, unsigned short dataPadLength ) {
+	Lane& lane = _lanes[_lane];
+	uint32_t frameHeader = (uint32_t)length | (lastFrame ? lastFrameFlag : 0);
+	size_t frameLength = frameHeaderSize + length;
+	lane.outputFile->write( (const char*)&frameHeader, sizeof( frameHeader ) );
+	if ( lastFrame ) {
+		lane.outputFile->write( (const char*)&dataPadLength, sizeof( dataPadLength ) );
+		frameLength += sizeof( dataPadLength );
+	}
+	if ( length > 0 ) {
+		lane.outputFile->write( data, length );
+	}
+	_volumes[lane.volume].position += frameLength;
+	_volumes[lane.volume].directory.back().dataLength += length;
+	lane.written += frameLength;
+}
+
+//Terminates the entries of every volume and appends their directories, each followed by the fixed size footer pointing back to it
+//Volumes closed off before the last entry are reopened for theirs, only now is it known how many volumes there are
+//Fails if anything written since open() didn't make it to disk
+int FeD_Writer::close() {
+	char endOfFile[4];
+	memset( endOfFile, 0xFF, sizeof( endOfFile ) );
+	for ( auto& lane : _lanes ) {
+		Volume& volume = _volumes[lane.volume];
+		lane.outputFile->write( endOfFile, sizeof( endOfFile ) );  //Write end of data byte sequence
+		volume.position += sizeof( endOfFile );
+		this->writeDirectory( *lane.outputFile, volume, (unsigned int)lane.volume + 1 );
+		lane.outputFile->close();
+	}
+	for ( size_t i = 0; i < _volumes.size(); i++ ) {
+		if ( std::any_of( _lanes.begin(), _lanes.end(), [&]( const Lane& lane ) { return lane.volume == i; } ) ) {
+			continue;
+		}
+		AsyncFileWriter& outputFile = *_lanes[0].outputFile;
+		if ( !outputFile.open( _volumes[i].path, false ) ) {
+			printf( "Error: Could not open \'%s\' for writing\n", _volumes[i].path.u8string().c_str() );
+			_failed = true;
+			continue;
+		}
+		outputFile.seek( _volumes[i].position );
+		this->writeDirectory( outputFile, _volumes[i], (unsigned int)i + 1 );
+		outputFile.close();
+	}
+
+	for ( auto& lane : _lanes ) {
+		if ( lane.outputFile->finish() != 0 ) {
+			_failed = true;
+		}
+	}
+	_volumes.clear();
+	_lanes.clear();
+	if ( _failed ) {
+		printf( "Error: Could not finish writing FeD file\n" );
+		return 1;
+	}
+	return _volumeOverrun ? 1 : 0;
+}
+
+void FeD_Writer::writeDirectory( AsyncFileWriter& outputFile, const Volume& volume, unsigned int number ) {
+	uint64_t directoryOffset = volume.position, entryCount = volume.directory.size();
+	for ( const auto& record : volume.directory ) {
+		outputFile.write( (const char*)&record.offset, sizeof( record.offset ) );
+		outputFile.write( (const char*)&record.index, sizeof( record.index ) );
+		outputFile.write( &record.initVector[0], blockSize );
+		outputFile.write( (const char*)&record.pathLength, sizeof( record.pathLength ) );
+		outputFile.write( (const char*)&record.pathPadLength, sizeof( record.pathPadLength ) );
+		outputFile.write( &record.path[0], record.pathLength );
+		outputFile.write( (const char*)&record.dataLength, sizeof( record.dataLength ) );
+		outputFile.write( (const char*)&record.dataPadLength, sizeof( record.dataPadLength ) );
+		outputFile.write( (const char*)&record.flags, sizeof( record.flags ) );
+		outputFile.write( (const char*)&record.originalLength, sizeof( record.originalLength ) );
+		outputFile.write( (const char*)&record.checksum, sizeof( record.checksum ) );
+	}
+	if ( _volumeSize > 0 ) {
+		uint32_t volumeNumber = number, volumeCount = (uint32_t)_volumes.size();
+		outputFile.write( (const char*)&_volumeSet, sizeof( _volumeSet ) );
+		outputFile.write( (const char*)&volumeNumber, sizeof( volumeNumber ) );
+		outputFile.write( (const char*)&volumeCount, sizeof( volumeCount ) );
+		outputFile.write( (const char*)VOLUME_SIGN, sizeof( VOLUME_SIGN ) );
+	}
+	outputFile.write( (const char*)&directoryOffset, sizeof( directoryOffset ) );
+	outputFile.write( (const char*)&entryCount, sizeof( entryCount ) );
+	outputFile.write( (const char*)DIRECTORY_SIGN, sizeof( DIRECTORY_SIGN ) );
+}
+
+
+
+//Reads the footer of a v6 file and the directory it points to
+static int readDirectory( EntrySource& source, unsigned char versionByte, bool verboseLogging, std::vector<FeD_DirectoryEntry>& directory ) {
+	//Read footer
+	if ( verboseLogging ) printf( "Reading directory..." );
+	uint64_t directoryOffset = 0, entryCount = 0;
+	const char* directorySign = nullptr;
+	uint64_t fileSize = source.size();
+	if ( fileSize >= (uint64_t)directoryFooterSize && source.seek( fileSize - directoryFooterSize ) ) {
+		readValue( source, directoryOffset );
+		readValue( source, entryCount );
+		directorySign = source.read( sizeof( DIRECTORY_SIGN ) );
+	}
+	if ( directorySign == nullptr || memcmp( directorySign, DIRECTORY_SIGN, sizeof( DIRECTORY_SIGN ) ) != 0 || !source.seek( directoryOffset ) ) {
+		printf( "Error: FeD file has no valid directory\n" );
+		return 1;
+	}
+
+	//Read directory
+	directory.clear();
+	directory.reserve( std::min( entryCount, fileSize / directoryRecordMinSize ) );
+	for ( uint64_t i = 0; i < entryCount; i++ ) {
+		FeD_DirectoryEntry record;
+		const char* initVector = nullptr;
+		bool validRecord = readValue( source, record.offset ) && readValue( source, record.index ) &&
+			(initVector = source.read( initVectorSize )) != nullptr;
+		if ( validRecord ) {
+			memcpy( record.initVector.data(), initVector, initVectorSize );
+		}
+		validRecord = validRecord && readValue( source, record.pathLength ) && readValue( source, record.pathPadLength ) &&
+			record.pathLength <= pathMaxSize && record.pathPadLength <= record.pathLength;
+		const char* path = validRecord ? source.read( record.pathLength ) : nullptr;
+		if ( path != nullptr ) {
+			record.path.assign( path, record.pathLength );
+		}
+		validRecord = path != nullptr && readValue( source, record.dataLength ) && readValue( source, record.dataPadLength ) &&
+			record.dataPadLength <= record.dataLength;
+		record.flags = 0;
+		record.volume = 0;
+		record.originalLength = record.dataLength - record.dataPadLength;
+		if ( validRecord && versionByte >= 0x07 ) {
+			validRecord = readValue( source, record.flags ) && readValue( source, record.originalLength ) &&
+				validDataLengths( record.flags, record.dataLength, record.dataPadLength, record.originalLength );
+		}
+		record.checksum = 0;
+		if ( validRecord && versionByte >= 0x08 ) {
+			validRecord = readValue( source, record.checksum );
+		}
+		if ( !validRecord ) {
+			printf( "Error: Directory record %llu is invalid\n", (unsigned long long)i );
+			return 1;
+		}
+		directory.push_back( std::move( record ) );
+	}
+	if ( verboseLogging ) printf( "Done!: %zu entries\n", directory.size() );
+	return 0;
+}
+
+//Turns a directory record into the same entry readEntryHeader would have produced, decrypting only its path
+static void readDirectoryEntry( const FeD_DirectoryEntry& record, unsigned char versionByte, const KeyContext& key, FeD_Entry& entry ) {
+	std::string buffer = record.path;
+	decryptPath( buffer, key, record.initVector, versionByte );
+	buffer.resize( buffer.size()-record.pathPadLength );
+	entry.setIndex( record.index );
+	entry.setInitVector( record.initVector.data() );
+	entry.setPath( &buffer[0], buffer.size() );
+	entry.setPathPadLength( record.pathPadLength );
+	entry.setDataLength( (size_t)record.originalLength );
+	entry.setDataPadLength( record.dataPadLength );
+	entry.setFlags( record.flags );
+	entry.setOriginalLength( record.originalLength );
+	entry.setChecksum( record.checksum );
+}
+
+namespace {
+	//Sources of a thread of its own, each volume is only opened once the thread reads from it
+	class VolumeSources {
+	public:
+		VolumeSources( const std::vector<std::filesystem::path>& fileNames ) : _fileNames( fileNames ), _sources( fileNames.size() ), _opened( fileNames.size(), false ) {};
+
+		EntrySource* get( unsigned int volume ) {
+			if ( !_opened[volume] ) {
+				_sources[volume] = openEntrySource( _fileNames[volume] );
+				_opened[volume] = true;
+			}
+			return _sources[volume].get();
+		}
+
+	private:
+		const std::vector<std::filesystem::path>& _fileNames;
+		std::vector<std::unique_ptr<EntrySource>> _sources;
+		std::vector<bool> _opened;
+	};
+}
+
+FeD_IndexedReader::FeD_IndexedReader() : _versionByte( 0 ), _pathIndexBuilt( false ) {
+}
+
+FeD_IndexedReader::~FeD_IndexedReader() {
+}
+
+int FeD_IndexedReader::open( std::filesystem::path fileName, bool verboseLogging ) {
+	return this->open( std::vector<std::filesystem::path>{ fileName }, verboseLogging );
+}
+
+int FeD_IndexedReader::open( const std::vector<std::filesystem::path>& volumes, bool verboseLogging ) {
+	_fileNames = volumes;
+	_sources.clear();
+	_directory.clear();
+	_recordsByIndex.clear();
+	_recordsByPath.clear();
+	_pathIndexBuilt = false;
+	for ( size_t volume = 0; volume < volumes.size(); volume++ ) {
+		std::unique_ptr<EntrySource> source = openEntrySource( volumes[volume] );
+		if ( source == nullptr ) {
+			return 1;
+		}
+		std::string signature;
+		unsigned char versionByte;
+		if ( readPreamble( *source, verboseLogging, signature, versionByte ) != 0 ) {
+			return 1;
+		}
+		if ( versionByte < 0x06 ) {
+			printf( "Error: FeD file \'v%u\' has no directory, it can only be read sequentially\n", versionByte );
+			return 1;
+		}
+		if ( volume > 0 && versionByte != _versionByte ) {
+			printf( "Error: Volume \'%s\' is \'v%u\', unlike the volumes before it\n", volumes[volume].u8string().c_str(), versionByte );
+			return 1;
+		}
+		_versionByte = versionByte;
+
+		std::vector<FeD_DirectoryEntry> directory;
+		if ( readDirectory( *source, _versionByte, verboseLogging, directory ) != 0 ) {
+			return 1;
+		}
+		for ( auto& record : directory ) {
+			record.volume = (unsigned int)volume;
+			_directory.push_back( std::move( record ) );
+		}
+		_sources.push_back( std::move( source ) );
+	}
+	//Lanes write entries to their volumes in turn, so entries next to each other by index are spread over every volume being written at the time
+	if ( volumes.size() > 1 ) {
+		std::stable_sort( _directory.begin(), _directory.end(), []( const FeD_DirectoryEntry& a, const FeD_DirectoryEntry& b ) { return a.index < b.index; } );
+	}
+	for ( size_t i = 0; i < _directory.size(); i++ ) {
+		_recordsByIndex.emplace( _directory[i].index, i );
+	}
+	return 0;
+}
+
+//Decrypts only the path of an entry, straight from the directory
+std::filesystem::path FeD_IndexedReader::entryPath( size_t i, std::string key ) const {
+	return this->entryPath( i, KeyContext( key ) );
+}
+
+std::filesystem::path FeD_IndexedReader::entryPath( size_t i, const KeyContext& key ) const {
+	FeD_Entry entry;
+	readDirectoryEntry( _directory.at( i ), _versionByte, key, entry );
+	return entry.path();
+}
+
+//Jumps straight to an entry without touching any of the entries before it
+int FeD_IndexedReader::readEntry( size_t i, std::string key, FeD_EntryVisitor& visitor, size_t bufferSize ) {
+	return this->readEntry( i, KeyContext( key ), visitor, bufferSize );
+}
+
+int FeD_IndexedReader::readEntry( size_t i, const KeyContext& key, FeD_EntryVisitor& visitor, size_t bufferSize ) {
+	if ( i >= _directory.size() ) {
+		printf( "Error: Entry %zu does not exist\n", i );
+		return 1;
+	}
+	std::vector<char> dataBuffer( bufferSize > 0 ? bufferSize : defaultStreamBufferSize );
+	bool endOfFile;
+	EntrySource& source = *_sources[_directory[i].volume];
+	if ( !source.seek( _directory[i].offset ) ) {
+		printf( "Error: Entry %zu lies outside the file\n", i );
+		return 1;
+	}
+	auto locateEntry = [&]( unsigned int index, uint64_t& offset ) -> EntrySource* {
+		auto found = _recordsByIndex.find( index );
+		if ( found == _recordsByIndex.end() ) {
+			return nullptr;
+		}
+		offset = _directory[found->second].offset;
+		return _sources[_directory[found->second].volume].get();
+	};
+	return ::readEntry( source, _versionByte, key, false, locateEntry, visitor, dataBuffer, endOfFile );
+}
+
+int FeD_IndexedReader::readEntries( const std::vector<size_t>& entries, const KeyContext& key, const std::vector<FeD_EntryVisitor*>& visitors, size_t bufferSize ) {
+	std::atomic<size_t> nextEntry( 0 ), failed( 0 );
+	auto readEntries = [&]( FeD_EntryVisitor& visitor ) {
+		VolumeSources sources( _fileNames );
+		auto locateEntry = [&]( unsigned int index, uint64_t& offset ) -> EntrySource* {
+			auto found = _recordsByIndex.find( index );
+			if ( found == _recordsByIndex.end() ) {
+				return nullptr;
+			}
+			offset = _directory[found->second].offset;
+			return sources.get( _directory[found->second].volume );
+		};
+		std::vector<char> dataBuffer( bufferSize > 0 ? bufferSize : defaultStreamBufferSize );
+		for ( size_t n = nextEntry++; n < entries.size(); n = nextEntry++ ) {
+			size_t i = entries[n];
+			bool endOfFile = false;
+			EntrySource* source = i < _directory.size() ? sources.get( _directory[i].volume ) : nullptr;
+			if ( i >= _directory.size() ) {
+				printf( "Error: Entry %zu does not exist\n", i );
+				failed++;
+			}
+			else if ( source == nullptr || !source->seek( _directory[i].offset ) ||
+				::readEntry( *source, _versionByte, key, false, locateEntry, visitor, dataBuffer, endOfFile ) != 0 || endOfFile ) {
+				printf( "Error: Entry %u could not be read\n", _directory[i].index );
+				failed++;
+			}
+		}
+	};
+	std::vector<std::thread> workers;
+	for ( size_t i = 1; i < visitors.size(); i++ ) {
+		workers.emplace_back( readEntries, std::ref( *visitors[i] ) );
+	}
+	if ( !visitors.empty() ) {
+		readEntries( *visitors[0] );
+	}
+	for ( auto& thread : workers ) {
+		thread.join();
+	}
+	return failed == 0 ? 0 : 1;
+}
+
+bool FeD_IndexedReader::findEntry( const std::filesystem::path& path, const KeyContext& key, size_t& i ) {
+	this->buildPathIndex( key );
+	auto found = _recordsByPath.find( path.generic_u8string() );
+	if ( found == _recordsByPath.end() ) {
+		return false;
+	}
+	i = found->second.record;
+	return true;
+}
+
+bool FeD_IndexedReader::latestUnderPath( const FeD_Entry& entry ) const {
+	if ( !_pathIndexBuilt ) {
+		return true;
+	}
+	auto found = _recordsByPath.find( entry.path().generic_u8string() );
+	return found == _recordsByPath.end() || found->second.index == entry.index();
+}
+
+//Entries stored more than once under the same path are found as the last of them, which is the one decoding leaves behind
+void FeD_IndexedReader::buildPathIndex( const KeyContext& key ) {
+	if ( _pathIndexBuilt ) {
+		return;
+	}
+	_pathIndexBuilt = true;
+	_recordsByPath.clear();
+	_recordsByPath.reserve( _directory.size() );
+	std::vector<char> dataBuffer;
+	std::string data;
+	std::vector<FeD_Entry> members;
+	FeD_Entry entry;
+	for ( size_t i = 0; i < _directory.size(); i++ ) {
+		readDirectoryEntry( _directory[i], _versionByte, key, entry );
+		if ( !(entry.flags() & solidFlag) ) {
+			_recordsByPath[entry.path().generic_u8string()] = { i, entry.index() };
+			continue;
+		}
+
+		if ( dataBuffer.empty() ) {
+			dataBuffer.resize( defaultStreamBufferSize );
+		}
+		size_t dataLength, position;
+		bool endOfFile = false;
+		EntrySource& source = *_sources[_directory[i].volume];
+		if ( !source.seek( _directory[i].offset ) || readEntryHeader( source, _versionByte, key, false, entry, dataLength, endOfFile ) != 0 || endOfFile ||
+			::readSolidBlock( source, _versionByte, key, entry, dataLength, dataBuffer, data, members, position ) != 0 ) {
+			printf( "Error: Solid block %u could not be read, its members can't be looked up\n", _directory[i].index );
+			continue;
+		}
+		for ( const auto& member : members ) {
+			_recordsByPath[member.path().generic_u8string()] = { i, member.index() };
+		}
+	}
+}
+
+namespace {
+	class EntryDiscarder : public FeD_EntryVisitor {
+	public:
+		void beginEntry( const FeD_Entry& ) override {};
+		void entryData( const FeD_Entry&, const char*, size_t ) override {};
+		void endEntry( const FeD_Entry& ) override {};
+	};
+}
+
+//Each thread reads through a source of its own, taking the next entry in file order whenever it's done with one
+//References aren't read again, they only have to point at an entry of the same length that is verified in its own right
+int FeD_IndexedReader::verify( const KeyContext& key, unsigned int threadCount, size_t& failedEntries, size_t bufferSize ) {
+	if ( threadCount == 0 ) {
+		threadCount = std::max( std::thread::hardware_concurrency(), 1u );
+	}
+	std::atomic<size_t> nextEntry( 0 ), failed( 0 );
+	auto verifyEntries = [&]() {
+		VolumeSources sources( _fileNames );
+		std::vector<char> dataBuffer( bufferSize > 0 ? bufferSize : defaultStreamBufferSize );
+		EntryDiscarder discarder;
+		for ( size_t i = nextEntry++; i < _directory.size(); i = nextEntry++ ) {
+			FeD_Entry entry;
+			size_t dataLength;
+			bool endOfFile = false;
+			EntrySource* source = sources.get( _directory[i].volume );
+			if ( source == nullptr || !source->seek( _directory[i].offset ) ||
+				readEntryHeader( *source, _versionByte, key, false, entry, dataLength, endOfFile ) != 0 || endOfFile ) {
+				printf( "Error: Entry %u could not be read\n", _directory[i].index );
+				failed++;
+				continue;
+			}
+
+			if ( entry.flags() & referenceFlag ) {
+				unsigned int targetIndex;
+				if ( readReferenceIndex( *source, _versionByte, key, entry, dataLength, dataBuffer, targetIndex ) != 0 ) {
+					failed++;
+					continue;
+				}
+				auto target = _recordsByIndex.find( targetIndex );
+				if ( target == _recordsByIndex.end() || _directory[target->second].flags & (referenceFlag | solidFlag) ||
+					_directory[target->second].originalLength != entry.dataLength() ) {
+					printf( "Error: Entry %u refers to entry %u, which is missing or invalid\n", entry.index(), targetIndex );
+					failed++;
+				}
+				else {
+					countEntry();
+				}
+			}
+			else if ( readEntryData( *source, _versionByte, key, entry, dataLength, discarder, entry, dataBuffer ) != 0 ) {
+				failed++;
+			}
+			else {
+				countEntry();
+			}
+		}
+	};
+	std::vector<std::thread> workers;
+	for ( unsigned int i = 1; i < std::min<size_t>( threadCount, _directory.size() ); i++ ) {
+		workers.emplace_back( verifyEntries );
+	}
+	verifyEntries();
+	for ( auto& thread : workers ) {
+		thread.join();
+	}
+	failedEntries = failed;
+	return failedEntries == 0 ? 0 : 1;
+}
+
+
+
+FeD_EntryStream::FeD_EntryStream() : _versionByte( 0 ), _index( 0 ), _backend( nullptr ), _compressed( false ), _failed( false ),
+	_dataOffset( 0 ), _storedLength( 0 ), _size( 0 ), _position( 0 ), _cachedBlock( SIZE_MAX ) {
+}
+
+FeD_EntryStream::~FeD_EntryStream() {
+}
+
+int FeD_EntryStream::open( const FeD_IndexedReader& reader, size_t i, const KeyContext& key ) {
+	_source.reset();
+	_blocks.clear();
+	_cachedBlock = SIZE_MAX;
+	_size = 0;
+	_position = 0;
+	_failed = false;
+	if ( i >= reader._directory.size() ) {
+		printf( "Error: Entry %zu does not exist\n", i );
+		return 1;
+	}
+	_versionByte = reader._versionByte;
+	std::vector<char> dataBuffer( defaultStreamBufferSize );
+	//Opens the entry of record, leaving the source at the start of its data
+	auto openRecord = [&]( const FeD_DirectoryEntry& record, FeD_Entry& entry, size_t& dataLength ) {
+		bool endOfFile = false;
+		_source = openEntrySource( reader._fileNames[record.volume] );
+		if ( _source == nullptr ) {
+			return 1;
+		}
+		if ( !_source->seek( record.offset ) ) {
+			printf( "Error: Entry %u lies outside the file\n", record.index );
+			return 1;
+		}
+		if ( readEntryHeader( *_source, _versionByte, key, false, entry, dataLength, endOfFile ) != 0 ) {
+			return 1;
+		}
+		if ( endOfFile ) {
+			printf( "Error: Entry %u could not be read\n", record.index );
+			return 1;
+		}
+		//v9 headers don't have the stored length, only the directory does
+		dataLength = (size_t)record.dataLength;
+		return 0;
+	};
+
+	FeD_Entry entry;
+	size_t dataLength;
+	if ( openRecord( reader._directory[i], entry, dataLength ) != 0 ) {
+		return 1;
+	}
+	//The encoder only ever refers to entries stored in full, so there's never more than one reference to follow
+	if ( entry.flags() & referenceFlag ) {
+		unsigned int targetIndex;
+		if ( readReferenceIndex( *_source, _versionByte, key, entry, dataLength, dataBuffer, targetIndex ) != 0 ) {
+			return 1;
+		}
+		auto found = reader._recordsByIndex.find( targetIndex );
+		if ( found == reader._recordsByIndex.end() || reader._directory[found->second].flags & referenceFlag ) {
+			printf( "Error: Entry %u refers to entry %u, which does not exist\n", entry.index(), targetIndex );
+			return 1;
+		}
+		if ( openRecord( reader._directory[found->second], entry, dataLength ) != 0 ) {
+			return 1;
+		}
+	}
+	if ( entry.flags() & solidFlag ) {
+		printf( "Error: Entry %u is a solid block, which can only be read whole\n", entry.index() );
+		_source.reset();
+		return 1;
+	}
+	_index = entry.index();
+	_dataOffset = _source->position();
+	_storedLength = dataLength;
+	_size = entry.dataLength();
+	_compressed = (entry.flags() & compressedFlag) != 0;
+	_backend = &cipherBackend( cipherScheme( _versionByte ) );
+	_backend->setup( key, &entry.initVector()[0], _state );
+	return 0;
+}
+
+bool FeD_EntryStream::seek( uint64_t position ) {
+	if ( _source == nullptr || position > _size ) {
+		return false;
+	}
+	_position = position;
+	return true;
+}
+
+size_t FeD_EntryStream::read( char* destination, size_t length ) {
+	if ( _source == nullptr || _failed ) {
+		return 0;
+	}
+	length = (size_t)std::min<uint64_t>( length, _size - _position );
+	if ( length == 0 ) {
+		return 0;
+	}
+	if ( !_compressed ) {
+		if ( this->readStored( _position, destination, length ) != 0 ) {
+			_failed = true;
+			return 0;
+		}
+		_position += length;
+		countBytes( length );
+		return length;
+	}
+
+	if ( _blocks.empty() && this->buildBlockIndex() != 0 ) {
+		_failed = true;
+		return 0;
+	}
+	size_t copied = 0;
+	while ( copied < length ) {
+		//Last block starting at or before the position
+		auto found = std::upper_bound( _blocks.begin(), _blocks.end(), _position, []( uint64_t position, const Block& block ) {
+			return position < block.originalOffset;
+		} );
+		size_t block = found - _blocks.begin() - 1;
+		if ( this->readBlock( block ) != 0 ) {
+			_failed = true;
+			break;
+		}
+		size_t blockPosition = (size_t)(_position - _blocks[block].originalOffset);
+		size_t copyLength = std::min( length - copied, _blocks[block].originalLength - blockPosition );
+		memcpy( destination + copied, &_blockData[blockPosition], copyLength );
+		copied += copyLength;
+		_position += copyLength;
+	}
+	countBytes( copied );
+	return copied;
+}
+
+//v9 data is split into frames that are all entryFrameSize long but the last, so the frame holding any position is known from the stored length alone
+int FeD_EntryStream::readStored( uint64_t position, char* destination, size_t length ) {
+	while ( length > 0 ) {
+		uint64_t offset;
+		size_t readLength;
+		if ( _versionByte < 0x09 ) {
+			if ( position + length > _storedLength ) {
+				printf( "Error: Entry %u is shorter than its header says\n", _index );
+				return 1;
+			}
+			offset = _dataOffset + position;
+			readLength = length;
+		}
+		else {
+			//The writer holds back the last blockSize bytes in case they're padding, so the last frame can run up to blockSize bytes past entryFrameSize
+			uint64_t lastFrame = _storedLength > entryFrameSize + blockSize ? (_storedLength - blockSize - 1) / entryFrameSize : 0;
+			uint64_t frame = std::min( position / entryFrameSize, lastFrame );
+			uint64_t framePosition = position - frame*entryFrameSize;
+			uint64_t frameOffset = _dataOffset + frame*(frameHeaderSize + entryFrameSize);
+			uint32_t frameHeader;
+			if ( !_source->seek( frameOffset ) || !readValue( *_source, frameHeader ) ) {
+				printf( "Error: Unexpected end of file\n" );
+				return 1;
+			}
+			//Every frame's header has to be where the stored length says it is, or the offset landed inside data
+			uint64_t frameLength = frameHeader & ~lastFrameFlag;
+			bool isLastFrame = (frameHeader & lastFrameFlag) != 0;
+			if ( isLastFrame != (frame == lastFrame) || frameLength != (isLastFrame ? _storedLength - lastFrame*entryFrameSize : entryFrameSize) ) {
+				printf( "Error: Entry %u has an invalid frame length\n", _index );
+				return 1;
+			}
+			if ( framePosition >= frameLength ) {
+				printf( "Error: Entry %u is shorter than its header says\n", _index );
+				return 1;
+			}
+			offset = frameOffset + frameHeaderSize + (isLastFrame ? sizeof( unsigned short ) : 0) + framePosition;
+			readLength = (size_t)std::min<uint64_t>( length, frameLength - framePosition );
+		}
+
+		const char* data;
+		{
+			PhaseTimer timer( Phase::Read );
+			data = _source->seek( offset ) ? _source->read( readLength ) : nullptr;
+		}
+		if ( data == nullptr ) {
+			printf( "Error: Unexpected end of file\n" );
+			return 1;
+		}
+		{
+			PhaseTimer timer( Phase::Cipher );
+			_backend->apply( _state, data, destination, readLength, position );
+		}
+		position += readLength;
+		destination += readLength;
+		length -= readLength;
+	}
+	return 0;
+}
+
+//Only the headers of the blocks are decrypted, a few bytes a block
+int FeD_EntryStream::buildBlockIndex() {
+	uint64_t originalOffset = 0, storedOffset = 0;
+	while ( originalOffset < _size ) {
+		uint32_t lengths[2];
+		if ( this->readStored( storedOffset, (char*)lengths, sizeof( lengths ) ) != 0 ) {
+			return 1;
+		}
+		if ( lengths[0] == 0 || lengths[0] > compressionBlockSize || lengths[1] > lengths[0] ) {
+			printf( "Error: Compressed data is corrupt\n" );
+			return 1;
+		}
+		_blocks.push_back( { originalOffset, storedOffset + compressionBlockHeaderSize, lengths[0], lengths[1] } );
+		originalOffset += lengths[0];
+		storedOffset += compressionBlockHeaderSize + lengths[1];
+	}
+	if ( originalOffset != _size ) {
+		printf( "Error: Entry %u does not decompress to its original length\n", _index );
+		return 1;
+	}
+	return 0;
+}
+
+int FeD_EntryStream::readBlock( size_t block ) {
+	if ( block == _cachedBlock ) {
+		return 0;
+	}
+	const Block& stored = _blocks[block];
+	_blockData.resize( compressionBlockSize );
+	if ( stored.storedLength == stored.originalLength ) {
+		if ( this->readStored( stored.storedOffset, &_blockData[0], stored.originalLength ) != 0 ) {
+			return 1;
+		}
+		_cachedBlock = block;
+		return 0;
+	}
+	_storedData.resize( stored.storedLength );
+	if ( this->readStored( stored.storedOffset, _storedData.data(), stored.storedLength ) != 0 ) {
+		return 1;
+	}
+	{
+		PhaseTimer timer( Phase::Compression );
+		if ( !decompressBlock( _storedData.data(), stored.storedLength, &_blockData[0], stored.originalLength ) ) {
+			printf( "Error: Compressed data is corrupt\n" );
+			return 1;
+		}
+	}
+	_cachedBlock = block;
+	return 0;
+}
+
+
+
+FeD_LazyReader::FeD_LazyReader() : _versionByte( 0 ), _verboseLogging( false ), _useDirectory( false ), _finished( true ), _nextEntry( 0 ) {
+}
+
+FeD_LazyReader::~FeD_LazyReader() {
+}
+
+int FeD_LazyReader::open( std::filesystem::path fileName, bool verboseLogging ) {
+	_verboseLogging = verboseLogging;
+	_finished = true;
+	_source = openEntrySource( fileName, false );
+	if ( _source == nullptr ) {
+		return 1;
+	}
+	std::string signature;
+	if ( readPreamble( *_source, verboseLogging, signature, _versionByte ) != 0 ) {
+		return 1;
+	}
+
+	//A damaged directory only costs the shortcut, the headers themselves are still there to walk
+	uint64_t firstEntry = _source->position();
+	_useDirectory = _versionByte >= 0x06 && readDirectory( *_source, _versionByte, verboseLogging, _directory ) == 0;
+	if ( !_useDirectory ) {
+		if ( _versionByte >= 0x06 ) printf( "Falling back to reading every header\n" );
+		_directory.clear();
+		_source->seek( firstEntry );
+	}
+	_nextEntry = 0;
+	_solidMembers.clear();
+	_finished = false;
+	return 0;
+}
+
+int FeD_LazyReader::next( std::string key, FeD_Entry& entry, bool& endOfEntries ) {
+	return this->next( KeyContext( key ), entry, endOfEntries );
+}
+
+int FeD_LazyReader::next( const KeyContext& key, FeD_Entry& entry, bool& endOfEntries ) {
+	while ( _solidMembers.empty() ) {
+		endOfEntries = _finished || (_useDirectory && _nextEntry >= _directory.size());
+		if ( endOfEntries ) {
+			_finished = true;
+			return 0;
+		}
+
+		size_t dataLength;
+		if ( _useDirectory ) {
+			const FeD_DirectoryEntry& record = _directory[_nextEntry++];
+			readDirectoryEntry( record, _versionByte, key, entry );
+			if ( !(entry.flags() & solidFlag) ) {
+				return 0;
+			}
+			//Members of a solid block are only listed in its data, which follows the header the record points at
+			bool endOfFile = false;
+			if ( !_source->seek( record.offset ) || readEntryHeader( *_source, _versionByte, key, false, entry, dataLength, endOfFile ) != 0 || endOfFile ) {
+				printf( "Error: Entry %u could not be read\n", record.index );
+				_finished = true;
+				return 1;
+			}
+		}
+		else {
+			if ( readEntryHeader( *_source, _versionByte, key, _verboseLogging, entry, dataLength, endOfEntries ) != 0 ) {
+				_finished = true;
+				return 1;
+			}
+			if ( endOfEntries ) {
+				_finished = true;
+				return 0;
+			}
+			if ( !(entry.flags() & solidFlag) ) {
+				if ( !skipEntryData( *_source, _versionByte, dataLength ) ) {
+					printf( "Error: Unexpected end of file\n" );
+					_finished = true;
+					return 1;
+				}
+				return 0;
+			}
+		}
+		if ( this->readSolidBlock( key, entry, dataLength ) != 0 ) {
+			_finished = true;
+			return 1;
+		}
+	}
+	entry = std::move( _solidMembers.front() );
+	_solidMembers.pop_front();
+	endOfEntries = false;
+	return 0;
+}
+
+//Queues up every member of the solid block whose data starts at the current position
+int FeD_LazyReader::readSolidBlock( const KeyContext& key, const FeD_Entry& block, size_t dataLength ) {
+	if ( _dataBuffer.empty() ) {
+		_dataBuffer.resize( defaultStreamBufferSize );
+	}
+	std::string data;
+	std::vector<FeD_Entry> members;
+	size_t position;
+	if ( ::readSolidBlock( *_source, _versionByte, key, block, dataLength, _dataBuffer, data, members, position ) != 0 ) {
+		return 1;
+	}
+	for ( auto& member : members ) {
+		member.setChecksum( crc32c( 0, &data[position], member.dataLength() ) );
+		position += member.dataLength();
+		_solidMembers.push_back( std::move( member ) );
+	}
+	return 0;
+}
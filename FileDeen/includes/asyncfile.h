@@ -0,0 +1,144 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+namespace FileDeen {
+
+	//Files are read ahead and written behind in blocks of this size, with up to asyncQueueDepth blocks in flight per file
+	const size_t asyncBlockSize = 1024*1024;
+	const unsigned int asyncQueueDepth = 3;
+	//Block buffers start at this alignment, which is what direct I/O asks of buffers, offsets and lengths
+	const size_t directAlignment = 4096;
+
+	//io_uring is used on Linux when the kernel allows it, everywhere else a background thread does regular reads and writes
+	//Disabling it only affects async files opened afterwards, benchmarks use it to compare the two
+	bool ioRingAvailable();
+	void setIoRingEnabled( bool enabled );
+	const char* asyncBackendName();
+
+#ifdef _WIN32
+	typedef void* AsyncFileHandle;
+#else
+	typedef int AsyncFileHandle;
+#endif
+
+	//Takes over standard output for data written through an AsyncFileWriter, printf output goes to standard error from then on
+	//Returns an invalid handle if it can't be duplicated
+	AsyncFileHandle takeStandardOutput();
+
+	class AsyncQueue;
+
+	//Reads a file front to back, the blocks after the one being read are already on their way while the caller works on it
+	//Files that fit in a single block are read directly, there is nothing to overlap them with
+	class AsyncFileReader {
+	public:
+		AsyncFileReader( unsigned int depth = asyncQueueDepth );
+		~AsyncFileReader();
+		AsyncFileReader( const AsyncFileReader& ) = delete;
+		AsyncFileReader& operator=( const AsyncFileReader& ) = delete;
+
+		bool open( const std::filesystem::path& pathToFile );
+		void close();
+
+		//Size as of when the file was opened, reads stop there even if it has grown since
+		uint64_t size() const { return _size; };
+
+		//Copies up to length bytes without consuming them, at most what's left of the block being read
+		size_t peek( char* destination, size_t length );
+		//Returns how many bytes were copied, fewer than length only at the end of the file or on errors
+		size_t read( char* destination, size_t length );
+		bool failed() const { return _failed; };
+
+	private:
+		struct Block {
+			std::vector<char> data;
+			size_t length = 0, position = 0;
+			uint64_t offset = 0;
+			bool inFlight = false, ready = false;
+		};
+
+		bool waitBlock( unsigned int slot );
+		void submitBlock( unsigned int slot );
+
+		std::unique_ptr<AsyncQueue> _queue;
+		std::vector<Block> _blocks;
+		AsyncFileHandle _file;
+		uint64_t _size, _nextOffset;
+		unsigned int _head;
+		bool _failed;
+	};
+
+	//Writes a file front to back from a few blocks of its own, the caller carries on as soon as its data is copied
+	//Closing doesn't wait for the file's last blocks, so writing one file overlaps with producing the next
+	class AsyncFileWriter {
+	public:
+		AsyncFileWriter( unsigned int depth = asyncQueueDepth );
+		~AsyncFileWriter();
+		AsyncFileWriter( const AsyncFileWriter& ) = delete;
+		AsyncFileWriter& operator=( const AsyncFileWriter& ) = delete;
+
+		//Existing files are truncated unless truncate is false, in which case writing starts at their beginning
+		//Direct files bypass the OS cache, which is meant for files far larger than it, they fall back to regular writes where it isn't supported
+		//Only write() can be used on direct files, and they must be closed to be cut down to the length written
+		bool open( const std::filesystem::path& pathToFile, bool truncate = true, bool direct = false );
+		//Writes to a pipe or other stream that can't seek, which is closed along with the writer
+		//writeAt() and seek() fail on streams
+		bool open( AsyncFileHandle stream );
+		//The file is closed for good once its writes finish, returns 1 if any write finished so far has failed
+		int close();
+		//Waits for the writes of every closed file, returns 1 if any write since the last finish() has failed
+		int finish();
+
+		//Reserves room on disk for length bytes without changing the file's size, so it isn't laid out in pieces as it grows
+		//Only a hint, filesystems that can't do it are left to grow the file as usual
+		void preallocate( uint64_t length );
+
+		void write( const char* data, size_t length );
+		//Overwrites data written earlier, waits for every write in flight first
+		void writeAt( uint64_t offset, const char* data, size_t length );
+		//Moves where write() continues from, waits for every write in flight first
+		void seek( uint64_t offset );
+		uint64_t position() const { return _position; };
+		bool failed() const { return _failed; };
+
+	private:
+		struct Block {
+			std::vector<char> data;
+			//Start of data, aligned to directAlignment
+			char* buffer = nullptr;
+			size_t length = 0;
+			uint64_t offset = 0;
+			AsyncFileHandle file;
+			//Length the file is cut down to once it's closed, direct writes are padded out to whole aligned blocks
+			uint64_t fileLength = 0;
+			bool inFlight = false, closeFile = false, direct = false;
+		};
+
+		void submitBlock();
+		void waitBlock( unsigned int slot );
+		void waitAll();
+
+		std::unique_ptr<AsyncQueue> _queue;
+		std::vector<Block> _blocks;
+		AsyncFileHandle _file;
+		uint64_t _position;
+		unsigned int _current;
+		bool _failed, _direct, _stream;
+	};
+
+	//Creates the folders output files go in, remembering the ones it has made so files sharing a folder only create it once
+	//Can be shared between threads
+	class DirectoryCache {
+	public:
+		bool create( const std::filesystem::path& folder );
+
+	private:
+		std::mutex _mutex;
+		std::unordered_set<std::filesystem::path::string_type> _folders;
+	};
+}
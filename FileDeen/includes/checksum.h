@@ -0,0 +1,13 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace FileDeen {
+
+	//CRC32C (Castagnoli) of entry data, using the SSE4.2 crc32 instruction when the CPU has it
+	//Start from 0 and pass each result back in to checksum data fed in any number of pieces
+	uint32_t crc32c( uint32_t crc, const char* data, size_t length );
+
+	//Whether crc32c() runs on the CPU's crc32 instruction rather than the table based fallback
+	bool hardwareChecksum();
+}
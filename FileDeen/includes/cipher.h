@@ -0,0 +1,90 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace FileDeen {
+
+	const int blockSize = 64,
+		blockMaskSize = blockSize*2;
+	//AES-256 works on 16 byte blocks with 15 round keys
+	const int aesBlockSize = 16,
+		aesRoundKeysSize = aesBlockSize*15;
+	//Per entry state of any cipher backend, see CipherBackend::setup
+	const int cipherStateSize = aesRoundKeysSize + aesBlockSize;
+
+	//Totals over every KeyContext created so far, for measuring what key setup costs per entry
+	struct KeySetupStats {
+		uint64_t count;
+		uint64_t nanoseconds;
+	};
+
+	//Key schedule derived from a user key
+	//Deriving it is expensive compared to encrypting a small entry, so it is set up once per archive and shared by every cipher call
+	//Holds the keys of every cipher backend, the archive being read decides which one is used
+	class KeyContext {
+	public:
+		explicit KeyContext( std::string key );
+
+		const char* randKey() const { return _randKey; };
+		char paddingByte() const { return _paddingByte; };
+		const unsigned char* aesRoundKeys() const { return _aesRoundKeys; };
+
+		//Combines the key with an initialization vector into the masks applied to even and odd blocks
+		void buildBlockMasks( const char* initVector, char* masks ) const;
+
+		static KeySetupStats setupStats();
+
+	private:
+		char _randKey[blockSize];
+		char _paddingByte;
+		unsigned char _aesRoundKeys[aesRoundKeysSize];
+	};
+
+	//Instruction sets the block mask kernel can run on, picked at runtime from what the CPU supports
+	enum class CipherKernel {
+		Scalar,
+		SSE2,
+		AVX2,
+		AVX512
+	};
+
+	//Applies the v5 CBC transform to data starting at byte 'position' of an entry
+	//masks holds the mask for even blocks followed by the mask for odd blocks, see buildBlockMasks
+	void applyBlockMasks( char* data, size_t length, size_t position, const char* masks );
+	//Same, but reads from source and writes to destination so read-only data needs no extra copy
+	void applyBlockMasks( const char* source, char* destination, size_t length, size_t position, const char* masks );
+
+	//Best kernel the CPU supports, and the one currently in use
+	CipherKernel supportedCipherKernel();
+	CipherKernel cipherKernel();
+	//Forces a kernel, e.g. for benchmarking, fails if the CPU does not support it
+	bool setCipherKernel( CipherKernel kernel );
+	const char* cipherKernelName( CipherKernel kernel );
+	//AES instructions are separate from the vector extensions, this is what AES-CTR runs on when kernel is the one in use
+	const char* aesKernelName( CipherKernel kernel );
+
+	//Every scheme XORs entry data with a keystream that depends on the key, the entry's initialization vector and the position in the entry
+	//Encrypting and decrypting are the same, and any range of an entry can be done on its own, so ranges of one entry can go to different threads
+	enum class CipherScheme {
+		//v5 transform, the keystream repeats every blockMaskSize bytes
+		BlockMasks,
+		//AES-256 in counter mode, the first 16 bytes of the initialization vector are the first counter block
+		//Its last 8 bytes count blocks as a big endian number, wrapping around without carrying into the first 8
+		AESCTR
+	};
+
+	class CipherBackend {
+	public:
+		virtual ~CipherBackend() {};
+
+		//Sets up what an entry needs to be encrypted into state, which is cipherStateSize bytes
+		virtual void setup( const KeyContext& key, const char* initVector, char* state ) const = 0;
+		//XORs length bytes of source, starting at byte position of the entry, into destination
+		//source and destination may be the same buffer, state is only read so it can be shared between threads
+		virtual void apply( const char* state, const char* source, char* destination, size_t length, uint64_t position ) const = 0;
+		virtual const char* name() const = 0;
+	};
+
+	const CipherBackend& cipherBackend( CipherScheme scheme );
+}
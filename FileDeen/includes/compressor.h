@@ -0,0 +1,58 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace FileDeen {
+
+	//Compressed entry data is a sequence of blocks, each holding up to compressionBlockSize bytes of the original data
+	//Every block starts with its original and stored lengths, blocks that wouldn't shrink are stored as they are
+	const size_t compressionBlockSize = 256*1024;
+	const int compressionBlockHeaderSize = sizeof( uint32_t )*2;
+
+	//Entropy probe run on the start of an entry, already compressed media and random data aren't worth compressing
+	const size_t compressionProbeSize = 64*1024;
+	bool isCompressible( const char* sample, size_t length );
+
+	//LZ77 compression of a single block, destination needs room for compressBound( length ) bytes
+	size_t compressBound( size_t length );
+	size_t compressBlock( const char* source, size_t length, char* destination );
+	//Fails instead of writing outside of destination when given corrupt data
+	bool decompressBlock( const char* source, size_t length, char* destination, size_t originalLength );
+
+	//Splits data fed through update() in any number of pieces into compressed blocks, appending them to output
+	class BlockCompressor {
+	public:
+		BlockCompressor();
+
+		void update( const char* data, size_t length, std::vector<char>& output );
+		void finish( std::vector<char>& output );
+
+	private:
+		void compress( std::vector<char>& output );
+
+		std::vector<char> _block;
+		//Match table, kept between blocks
+		std::vector<uint32_t> _table;
+		size_t _blockLength;
+	};
+
+	//Reassembles blocks from data fed through update() in any number of pieces, passing on each one as it's decompressed
+	class BlockDecompressor {
+	public:
+		BlockDecompressor();
+
+		int update( const char* data, size_t length, const std::function<void( const char*, size_t )>& output );
+		//Fails if the data ended partway through a block
+		int finish();
+
+		uint64_t totalLength() const { return _totalLength; };
+
+	private:
+		std::vector<char> _input;
+		//Only allocated once a block that was actually compressed comes through
+		std::vector<char> _block;
+		uint64_t _totalLength;
+	};
+}
@@ -10,11 +10,13 @@ namespace FileDeen {
 
 		std::string getString( std::string );
 		bool getBool( std::string );
+		int getInt( std::string );
 
 		void read();
 	private:
 		void write();
 		std::map<std::string, bool> _boolOptions;
+		std::map<std::string, int> _intOptions;
 		std::map<std::string, std::string> _stringOptions;
 		std::filesystem::path _filePath;
 	};
@@ -0,0 +1,119 @@
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "asyncfile.h"
+#include "filedeen.h"
+
+namespace FileDeen {
+
+	const size_t noDuplicate = SIZE_MAX;
+
+	//A file to be stored as one entry, size is as of when it was found
+	//Duplicates are stored as a reference to the job they duplicate instead of holding their own copy of the data
+	//unless that job couldn't be stored in full itself, in which case they're stored in full after all
+	struct EncodeJob {
+		std::filesystem::path sourceFile;
+		std::filesystem::path relativePath;
+		uint64_t size = 0;
+		size_t duplicateOf = noDuplicate;
+	};
+
+	//Walks every given file and folder once into the jobs to encode them with, reading folders on threadCount threads
+	//Folders are stored under their own name, or just their contents with onlyFolderContents, jobs of each folder are sorted by path
+	//Fails if anything given or any folder inside couldn't be read, the jobs that were found are still returned
+	int scanFiles( const std::vector<std::filesystem::path>& paths, bool onlyFolderContents, unsigned int threadCount, std::vector<EncodeJob>& jobs );
+
+	//Reads and encrypts entries on a pool of worker threads, while the calling thread commits them to the archive in index order
+	//Indices continue from the writer's nextIndex(), so jobs can be appended to an existing file
+	//Entries are independent of one another, so the output is the same as encoding them one after another
+	//Buffered data is capped at bufferSize*threadCount*2 bytes no matter how large the entries are
+	class ParallelEncoder {
+	public:
+		ParallelEncoder( unsigned int threadCount, size_t bufferSize = defaultStreamBufferSize );
+
+		//Compresses entries that look compressible before encrypting them
+		void setCompression( bool compress ) { _compress = compress; };
+		//Packs files no larger than threshold bytes into solid blocks, which are stored as single entries, 0 stores every file on its own
+		//Duplicates and the files they duplicate are always stored on their own
+		void setSolidThreshold( uint64_t threshold ) { _solidThreshold = std::min<uint64_t>( threshold, solidBlockSize ); };
+
+		//Marks every job whose file is byte for byte identical to an earlier one, returns how many were found
+		//Only files sharing their size with another, going by the size in their job, are hashed, and matching hashes are confirmed by comparing the files
+		size_t findDuplicates( std::vector<EncodeJob>& jobs );
+
+		int encode( const std::vector<EncodeJob>& jobs, FeD_Writer& writer, const KeyContext& key, bool verboseLogging );
+
+		unsigned int threadCount() const { return _threadCount; };
+
+	private:
+		//FIFO of chunks that keeps its storage once it has grown, unlike a deque which allocates as chunks pass through it
+		class ChunkQueue {
+		public:
+			bool empty() const { return _first == _chunks.size(); };
+			std::vector<char>& front() { return _chunks[_first]; };
+			void pop_front();
+			void push_back( std::vector<char>&& chunk );
+
+		private:
+			std::vector<std::vector<char>> _chunks;
+			size_t _first = 0;
+		};
+
+		//Whether a job has been committed yet, and whether it made it in whole, for copies waiting to refer to it
+		enum class JobState : char {
+			Pending,
+			Stored,
+			Failed
+		};
+
+		struct Slot {
+			std::unique_ptr<FeD_Entry> entry;
+			ChunkQueue chunks;
+			//Padding length and checksum, set once the entry is finished
+			unsigned short dataPadLength = 0;
+			unsigned int checksum = 0;
+			//Failed entries are only ever flagged before any of their data is pushed, and aren't written
+			//Incomplete entries, such as files that changed while being read, are still written, but count as failed
+			bool opened = false, finished = false, failed = false, incomplete = false;
+		};
+
+		void planUnits();
+		void worker();
+		//A cleared entry from the pool, whose initialization vector is generated from its index
+		std::unique_ptr<FeD_Entry> newEntry( unsigned int index );
+		//An emptied buffer from the pool, keeping the storage of whatever chunk it last held
+		std::vector<char> newBuffer();
+		void encodeJob( size_t unit, size_t index, Slot& slot, AsyncFileReader& inputFile );
+		void encodeSolidBlock( size_t unit, Slot& slot, AsyncFileReader& inputFile );
+		void encodeReference( size_t index, Slot& slot, std::unique_ptr<FeD_Entry> entry );
+		//Waits for the writer to commit a job, returns whether it was stored whole
+		bool waitForJob( size_t index );
+		void encodeCompressedJob( size_t unit, size_t index, Slot& slot, std::unique_ptr<FeD_Entry> entry, AsyncFileReader& inputFile, size_t length );
+
+		unsigned int _threadCount;
+		size_t _bufferSize, _memoryBudget;
+		bool _compress;
+		uint64_t _solidThreshold;
+
+		const std::vector<EncodeJob>* _jobs;
+		const KeyContext* _key;
+		unsigned int _firstIndex;
+		//Random for every encode() call, AES-CTR must never see the same initialization vector twice under one key
+		uint64_t _initVectorSeed;
+		//Each unit is committed as one entry, either a single job or a solid block of several
+		std::vector<std::vector<size_t>> _units;
+		std::vector<Slot> _slots;
+		std::vector<JobState> _jobStates;
+		std::vector<std::vector<char>> _freeBuffers;
+		std::vector<std::unique_ptr<FeD_Entry>> _freeEntries;
+		size_t _nextUnit, _head, _bufferedBytes;
+		std::mutex _mutex;
+		std::condition_variable _condition;
+	};
+}
@@ -1,11 +1,27 @@
 #pragma once
+#include <array>
+#include <cstdint>
+#include <deque>
 #include <filesystem>
+#include <fstream>
+#include <memory>
+#include <random>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
+#include "asyncfile.h"
+#include "cipher.h"
 
 namespace FileDeen {
-	
-	const int blockSize = 64;
+
+	//v6 appends a directory of every entry after the end of data byte sequence, for random access
+	//v7 adds flags and the original data length to every entry header and directory record, for compressed and duplicate entries
+	//v8 adds a CRC32C of the original data to every entry header and directory record, see checksum.h
+	//v9 stores entry data as frames, with the padding length and checksum after the data instead of in the header, so files can be piped without seeking
+	//v10 encrypts with AES-256 in counter mode instead of the v5 transform, see CipherScheme, the layout is that of v9
+	const unsigned char formatVersion = 0x0A,
+		minimumFormatVersion = 0x05;
 
 	const unsigned char SIGN[8] = { 0x53, 0x30, 0x53, 0x30, 0x72, 0x7F, 0x0D, 0x54 };
 	//                               83    48    83    48   114   127    13    84
@@ -18,75 +34,464 @@ namespace FileDeen {
 		initVectorSize = blockSize,
 		dataLengthSize = sizeof( size_t ),
 		paddingLengthSize = sizeof( short )*2,
-		pathMaxSize = 256*sizeof( wchar_t ),
+		pathMaxSize = 256*sizeof( char16_t ),
 		checksumSize = sizeof( unsigned int ),
-		entryMaxMetadataSize = indexSize+initVectorSize+pathMaxSize+dataLengthSize+checksumSize;
+		entryFlagsSize = sizeof( char )+sizeof( uint64_t ),
+		entryMaxMetadataSize = indexSize+initVectorSize+pathMaxSize+dataLengthSize+checksumSize+entryFlagsSize;
+
+	//Every frame of v9 entry data is a uint32 length followed by that many bytes, every frame but the last is entryFrameSize bytes long
+	//The last has lastFrameFlag set in its length and the uint16 padding length right after it, and is followed by the uint32 checksum
+	const uint32_t lastFrameFlag = 0x80000000;
+	const size_t entryFrameSize = 64*1024;
+	const int frameHeaderSize = sizeof( uint32_t );
+
+	//Entry data was compressed before being encrypted, see compressor.h
+	//Entry is a duplicate of an earlier one, its data is only the index of that entry as a uint32
+	//Entry is a solid block of small files with an empty path of its own, its data is a member table followed by every member's data in order
+	const unsigned char compressedFlag = 0x01,
+		referenceFlag = 0x02,
+		solidFlag = 0x04;
+
+	//Solid blocks are closed once they hold this much data or this many members, members are never larger than the block size
+	//A block takes the highest index of its members, so the highest index in a file is still that of an entry
+	const size_t solidBlockSize = 4*1024*1024,
+		solidBlockMembers = 16*1024;
+
+	const unsigned char DIRECTORY_SIGN[8] = { 0x46, 0x65, 0x44, 0x5F, 0x44, 0x49, 0x52, 0x06 };
+	//                                         70   101    68    95    68    73    82     6
+
+	const int directoryFooterSize = sizeof( uint64_t )*2+sizeof( DIRECTORY_SIGN ),
+		directoryRecordMinSize = sizeof( uint64_t )*2+indexSize+initVectorSize+paddingLengthSize+sizeof( short );
+
+	//Every volume of a file split into volumes is a whole v6 file of its own, holding some of the entries
+	//Between its directory and footer, where readers of single files never look, it has the uint64 id shared by every volume of the file,
+	//its uint32 number counting from 1 and the uint32 number of volumes, followed by this sequence
+	const unsigned char VOLUME_SIGN[8] = { 0x46, 0x65, 0x44, 0x5F, 0x56, 0x4F, 0x4C, 0x08 };
+	//                                      70   101    68    95    86    79    76     8
+
+	const int volumeInfoSize = sizeof( uint64_t )+sizeof( uint32_t )*2+sizeof( VOLUME_SIGN );
+
+	const size_t defaultStreamBufferSize = 4*1024*1024;
+
+	//Entry paths are stored as UTF-16LE with '\\' separators on every platform, the way Windows builds have always written them
+	std::string encodePath( const std::filesystem::path& path );
+	std::filesystem::path decodePath( const char* data, size_t length );
+
+	//What readers do with a file whose version can't be decoded with certainty
+	enum class VersionMismatch {
+		Ask,
+		Refuse,
+		Continue
+	};
+
+	void setVersionMismatch( VersionMismatch action );
+	VersionMismatch versionMismatch();
+
+	//Version byte of a FeD file, without reading any further, for picking how to read it
+	int readVersion( std::filesystem::path pathToFile, unsigned char& versionByte );
+	//Cipher the paths and data of a file of the given version are encrypted with
+	CipherScheme cipherScheme( unsigned char versionByte );
+
+	//Volumes are named after the file they were split from, with ".001", ".002" and so on added
+	std::filesystem::path volumePath( const std::filesystem::path& folder, const std::filesystem::path& fileName, unsigned int number );
+	//Finds every volume of a file split into volumes, in the folder of pathToFile or any of the folders given
+	//pathToFile can be the name the file was split from or any one of its volumes, files that aren't split are their own only volume
+	int findVolumes( std::filesystem::path pathToFile, const std::vector<std::filesystem::path>& folders, std::vector<std::filesystem::path>& volumes );
+
+
+	typedef std::array<char, blockSize> InitVector;
 
+	//Entry data is encrypted with the cipher of versionByte, which is that of the current version when writing
+	unsigned short CBCEncrypt( std::string& data, std::string key, const InitVector& initVector );
+	unsigned short CBCEncrypt( std::string& data, const KeyContext& key, const InitVector& initVector, unsigned char versionByte = formatVersion );
+	void CBCDecrypt( std::string& data, std::string key, const InitVector& initVector );
+	void CBCDecrypt( std::string& data, const KeyContext& key, const InitVector& initVector, unsigned char versionByte = formatVersion );
 
-	unsigned short CBCEncrypt( std::string& data, std::string key, std::vector<char> initVector );
-	void CBCDecrypt( std::string& data, std::string key, std::vector<char> initVector);
+	//Paths share their entry's initialization vector, but start this far into its keystream so they never reuse the part the data is encrypted with
+	//It's a whole number of v5 mask periods, so paths of older versions come out the same as they always have
+	const uint64_t pathCipherPosition = 1ull << 62;
+	unsigned short encryptPath( std::string& path, const KeyContext& key, const InitVector& initVector );
+	void decryptPath( std::string& path, const KeyContext& key, const InitVector& initVector, unsigned char versionByte );
 
+	//Incremental CBCEncrypt, data fed through update() in any number of pieces is encrypted exactly as one CBCEncrypt call would
+	class CBCEncryptStream {
+	public:
+		CBCEncryptStream( std::string key, const InitVector& initVector );
+		CBCEncryptStream( const KeyContext& key, const InitVector& initVector, unsigned char versionByte = formatVersion );
+
+		void update( char* data, size_t length );
+
+		static unsigned short paddingLength( size_t length ) { return length % blockSize; };
+		char paddingByte() const { return _paddingByte; };
+
+	private:
+		const CipherBackend* _backend;
+		char _state[cipherStateSize];
+		char _paddingByte;
+		uint64_t _position;
+	};
+
+	//Incremental CBCDecrypt, data fed through update() in any number of pieces is decrypted exactly as one CBCDecrypt call would
+	class CBCDecryptStream {
+	public:
+		CBCDecryptStream( std::string key, const InitVector& initVector );
+		CBCDecryptStream( const KeyContext& key, const InitVector& initVector, unsigned char versionByte = formatVersion );
+
+		void update( char* data, size_t length );
+		void update( const char* source, char* destination, size_t length );
+
+	private:
+		const CipherBackend* _backend;
+		char _state[cipherStateSize];
+		uint64_t _position;
+	};
+
+	//One file packed into a solid block, the member table is a uint32 count followed by every member's
+	//uint32 index, uint32 data length, uint16 path length and UTF-16LE path, see encodePath
+	struct FeD_SolidMember {
+		unsigned int index;
+		uint32_t dataLength;
+		std::string path;
+	};
+
+	const int solidMemberSize = sizeof( uint32_t )*2+sizeof( uint16_t );
+
+	void writeSolidTable( const std::vector<FeD_SolidMember>& members, std::string& data );
+
+	//Entries own their data and are only ever moved, copyHeader() makes the one kind of copy that's cheap
 	class FeD_Entry {
 	public:
-		FeD_Entry( std::seed_seq initVectorSeed );
+		//Entries read back start with a zero initialization vector, entries to be written are given a seed to generate theirs from
+		FeD_Entry();
+		explicit FeD_Entry( uint64_t initVectorSeed );
+		FeD_Entry( FeD_Entry&& ) = default;
+		FeD_Entry& operator=( FeD_Entry&& ) = default;
+		FeD_Entry( const FeD_Entry& ) = delete;
+		FeD_Entry& operator=( const FeD_Entry& ) = delete;
+
+		//Everything but the data
+		FeD_Entry copyHeader() const;
+		//Back to a new entry, keeping the storage of its path and data for the next one
+		void clear();
 
-		void setIndex( char* data, size_t length);
+		void setIndex( const char* data, size_t length );
 		void setIndex( unsigned int i );
 		unsigned int index() const { return _index; };
 
-		const std::vector<char> initVector() const { return _initVector; };
-		void setInitVector( std::vector<char> initVector );
-		void regenerateInitVector( std::seed_seq seed );
+		const InitVector& initVector() const { return _initVector; };
+		void setInitVector( const char* initVector );
+		void regenerateInitVector( uint64_t seed );
 
-		void setPath( char* data, size_t length );
-		void setPath( std::wstring path );
+		void setPath( const char* data, size_t length );
+		void setPath( std::filesystem::path path );
 		void setPathPadLength( unsigned short length );
-		std::filesystem::path path() const { return _path; };
+		std::filesystem::path path() const { return decodePath( &_path[0], _pathLength ); };
 
 		size_t dataLength() const { return _dataLength; };
+		void setDataLength( size_t length );
+
+		unsigned char flags() const { return _flags; };
+		void setFlags( unsigned char flags );
+		//Length of compressed or referenced data as it was originally, entries read back already report it as dataLength()
+		void setOriginalLength( uint64_t length );
 
-		void setData( char* data, size_t length );
+		//CRC32C of the original data, references have none of their own and are checked through the entry they refer to
+		unsigned int checksum() const { return _checksum; };
+		void setChecksum( unsigned int checksum );
+
+		void setData( const char* data, size_t length );
+		unsigned short dataPadLength() const { return _dataPadLength; };
 		void setDataPadLength( unsigned short length );
 		void moveData( std::string& data );
-		std::string data() const { return _data; };
+		std::string_view data() const { return std::string_view( _data.data(), _data.size() ); };
 
 		void writeDataToFile( std::filesystem::path filePath );
-		void writeToFile( std::filesystem::path rootFolder, bool useRealNames, bool verboseLogging );
+		//Where the entry is decoded to, under its real name or its index
+		//Paths come from the file being decoded, an absolute one or one going up a folder would lead outside rootFolder and gives an empty path
+		std::filesystem::path outputPath( const std::filesystem::path& rootFolder, bool useRealNames ) const;
+		//Folders are created through folders when given, so entries sharing one only create it once
+		void writeToFile( std::filesystem::path rootFolder, bool useRealNames, bool verboseLogging, DirectoryCache* folders = nullptr );
+		//Appends the header as it's stored in a file
+		void writeHeader( std::string& header ) const;
 
 	private:
 		friend class FeD;
+		friend class FeD_Writer;
 		unsigned int _index, _checksum;
-		std::vector<char> _initVector;
+		InitVector _initVector;
 		unsigned short _pathLength, _pathPadLength;
-		std::wstring _path;
+		std::string _path;
 		size_t _dataLength;
 		unsigned short _dataPadLength;
+		unsigned char _flags;
+		uint64_t _originalLength;
 		std::string _data;
 	};
 
+	//Receives entries from FeD::readFromFile one at a time
+	//Entry data arrives already decrypted and unpadded, in chunks no larger than the reader's buffer
+	class FeD_EntryVisitor {
+	public:
+		virtual ~FeD_EntryVisitor() {};
+
+		//Asked before anything is read of an entry's data, entries turned down are skipped over without being decrypted
+		//Solid blocks are always decrypted, the question is asked of each member instead
+		virtual bool wantsEntry( const FeD_Entry& ) { return true; };
+		virtual void beginEntry( const FeD_Entry& entry ) = 0;
+		virtual void entryData( const FeD_Entry& entry, const char* data, size_t length ) = 0;
+		virtual void endEntry( const FeD_Entry& entry ) = 0;
+	};
+
 	class FeD {
 	public:
 		FeD();
 
-		void setSignature(char* data, size_t length );
-		std::string signature() const { return _signature; };
+		void setSignature( const char* data, size_t length );
+		const std::string& signature() const { return _signature; };
 
 		const unsigned char version() const { return _versionByte; };
 
-		void addEntry( FeD_Entry entry );
+		void addEntry( FeD_Entry&& entry );
 		void moveEntry( FeD_Entry& entry );
 		void delEntry( int index );
 		FeD_Entry& entry( int index );
-		std::vector<FeD_Entry> entries() const { return _entries; };
+		const std::vector<FeD_Entry>& entries() const { return _entries; };
 		size_t numEntries() const { return _entries.size(); };
 
 		int readFromFile( std::filesystem::path path, std::string key, bool verboseLogging );
+		int readFromFile( std::filesystem::path path, std::string key, bool verboseLogging, FeD_EntryVisitor& visitor, size_t bufferSize = defaultStreamBufferSize );
+		int readFromFile( std::filesystem::path path, const KeyContext& key, bool verboseLogging, FeD_EntryVisitor& visitor, size_t bufferSize = defaultStreamBufferSize );
+		//Reads a FeD file piped into standard input front to back, never going back over anything already read
+		//References can't be read this way, the entries they refer to have already gone by
+		int readFromInput( const KeyContext& key, bool verboseLogging, FeD_EntryVisitor& visitor, size_t bufferSize = defaultStreamBufferSize );
 		void writeToFile( std::filesystem::path pathToFile );
 
 	private:
-		const unsigned char _versionByte = 0x05;
+
+		const unsigned char _versionByte = formatVersion;
 		std::string _signature;
 		std::vector<FeD_Entry> _entries;
 		bool _omittedBytes[256];
 	};
+
+	//Location and header of one entry, as recorded in the directory of a v6 file
+	struct FeD_DirectoryEntry {
+		uint64_t offset;
+		unsigned int index;
+		InitVector initVector;
+		unsigned short pathLength, pathPadLength;
+		std::string path;
+		uint64_t dataLength;
+		unsigned short dataPadLength;
+		unsigned char flags;
+		uint64_t originalLength;
+		unsigned int checksum;
+		//Position of the volume holding the entry among the volumes read, not stored
+		unsigned int volume;
+	};
+
+	//Writes a FeD file one entry at a time, streaming each entry's data from its source file
+	//Only bufferSize bytes of entry data are held in memory at once, regardless of file sizes
+	class FeD_Writer {
+	public:
+		FeD_Writer( size_t bufferSize = defaultStreamBufferSize );
+
+		//Compresses entries passed to writeEntry() that look compressible
+		void setCompression( bool compress ) { _compress = compress; };
+		//Splits the file into volumes of at most volumeSize bytes, see volumePath(), must be set before open()
+		//Each folder is given volumes of its own to fill at the same time as the others, the folder of the file given to open() always is
+		//Entries are never split, one too large for any volume is given one of its own that goes over volumeSize, which fails close()
+		//Folders that don't exist yet are created
+		void setVolumes( uint64_t volumeSize, const std::vector<std::filesystem::path>& folders );
+
+		int open( std::filesystem::path pathToFile, std::string signature );
+		//Writes the file front to back into a handle that's already open, like one from takeStandardOutput(), which is closed along with the file
+		//Files written this way can't be split into volumes
+		int open( AsyncFileHandle output, std::string signature );
+		//Adds entries to the end of an existing file of the current version, without rewriting the entries already in it
+		//Files split into volumes can't be appended to
+		int openForAppend( std::filesystem::path pathToFile );
+		//Index new entries should continue from, past every entry already in an appended file
+		unsigned int nextIndex() const { return _nextIndex; };
+		int writeEntry( FeD_Entry& entry, std::filesystem::path sourceFile, std::string key );
+		int writeEntry( FeD_Entry& entry, std::filesystem::path sourceFile, const KeyContext& key );
+		void writeHeader( const FeD_Entry& entry );
+		//Data already encrypted, in pieces of any size, which are put together into frames
+		void writeData( const char* data, size_t length );
+		//Ends the data of the entry written last with the last frame, holding its padding, and its checksum
+		void finishEntry( unsigned short dataPadLength, unsigned int checksum );
+		int close();
+
+	private:
+		//One file of the output, which is the whole file unless it's split into volumes
+		struct Volume {
+			std::filesystem::path path;
+			//End of the entries written so far
+			uint64_t position;
+			uint64_t directoryLength;
+			std::vector<FeD_DirectoryEntry> directory;
+		};
+		//Volumes are filled one after another on each lane, lanes write through queues of their own so volumes on different disks are written at once
+		struct Lane {
+			std::filesystem::path folder;
+			std::unique_ptr<AsyncFileWriter> outputFile;
+			size_t volume;
+			uint64_t written;
+		};
+
+		int writeCompressedEntry( FeD_Entry& entry, std::fstream& inputFile, size_t length, std::filesystem::path sourceFile, const KeyContext& key );
+		void openVolume( Lane& lane, std::filesystem::path pathToFile );
+		void startVolume( Lane& lane, std::filesystem::path pathToFile );
+		void writeFrame( const char* data, size_t length, bool lastFrame, unsigned short dataPadLength );
+		void writeDirectory( AsyncFileWriter& outputFile, const Volume& volume, unsigned int number );
+
+		std::vector<char> _buffer;
+		//Headers are assembled here, kept between entries so its storage is reused
+		std::string _header;
+		//Data not yet written out as a frame, the last blockSize bytes are always kept back in case they end up holding the padding
+		std::vector<char> _frame;
+		std::string _signature;
+		bool _compress, _failed;
+		//Set once an entry had to be given a volume larger than the volume size
+		bool _volumeOverrun;
+		unsigned int _nextIndex;
+		uint64_t _volumeSize, _volumeSet;
+		std::vector<std::filesystem::path> _volumeFolders;
+		std::vector<Volume> _volumes;
+		std::vector<Lane> _lanes;
+		//Lane of the entry being written
+		size_t _lane;
+	};
+
+	class EntrySource;
+
+	//Random access to the entries of a v6 file through its directory, without reading the entries in between
+	//Files split into volumes are read as one, with the entries of every volume ordered by index, see findVolumes()
+	class FeD_IndexedReader {
+	public:
+		FeD_IndexedReader();
+		~FeD_IndexedReader();
+
+		int open( std::filesystem::path pathToFile, bool verboseLogging );
+		int open( const std::vector<std::filesystem::path>& volumes, bool verboseLogging );
+
+		unsigned char version() const { return _versionByte; };
+		size_t numEntries() const { return _directory.size(); };
+		const FeD_DirectoryEntry& directoryEntry( size_t i ) const { return _directory.at( i ); };
+		std::filesystem::path entryPath( size_t i, std::string key ) const;
+		std::filesystem::path entryPath( size_t i, const KeyContext& key ) const;
+
+		int readEntry( size_t i, std::string key, FeD_EntryVisitor& visitor, size_t bufferSize = defaultStreamBufferSize );
+		int readEntry( size_t i, const KeyContext& key, FeD_EntryVisitor& visitor, size_t bufferSize = defaultStreamBufferSize );
+		//Reads the given entries on one thread per visitor, each thread reading through a source of its own and passing what it reads to its own visitor
+		//Entries are handed out in the order given, a failed entry doesn't stop the rest from being read, returns 1 if any failed
+		int readEntries( const std::vector<size_t>& entries, const KeyContext& key, const std::vector<FeD_EntryVisitor*>& visitors, size_t bufferSize = defaultStreamBufferSize );
+
+		//Finds the entry stored under path, members of solid blocks are found as the block holding them
+		//The first lookup decrypts every path into a hash index, after which lookups take about the same time however many entries there are
+		//Building the index takes decoding the member table of every solid block, and every lookup has to use the same key
+		bool findEntry( const std::filesystem::path& path, const KeyContext& key, size_t& i );
+		//Builds the index findEntry() uses, which has to be done before the reader is shared between threads
+		void buildPathIndex( const KeyContext& key );
+		//Whether entry is the last one stored under its path, the one decoding to real names should leave behind
+		//Always true until the path index is built
+		bool latestUnderPath( const FeD_Entry& entry ) const;
+
+		unsigned int numVolumes() const { return (unsigned int)_fileNames.size(); };
+
+		//Decrypts and checksums every entry on threadCount threads without passing their data anywhere, 0 uses every hardware thread
+		//Sets failedEntries to the number of entries that are damaged or were encoded with a different key
+		int verify( const KeyContext& key, unsigned int threadCount, size_t& failedEntries, size_t bufferSize = defaultStreamBufferSize );
+
+	private:
+		friend class FeD_EntryStream;
+
+		struct PathRecord {
+			size_t record;
+			unsigned int index;
+		};
+
+		//Sources are opened by each thread reading, the ones here are for reads made from the calling thread
+		std::vector<std::filesystem::path> _fileNames;
+		std::vector<std::unique_ptr<EntrySource>> _sources;
+		unsigned char _versionByte;
+		std::vector<FeD_DirectoryEntry> _directory;
+		//Positions in the directory by entry index, and by path along with the index of the last entry stored under it
+		std::unordered_map<unsigned int, size_t> _recordsByIndex;
+		std::unordered_map<std::string, PathRecord> _recordsByPath;
+		bool _pathIndexBuilt;
+	};
+
+	//Reads any range of a single entry without decrypting the rest of it, for entries of files FeD_IndexedReader can open
+	//Every cipher's keystream can be started at any position, so only the frames holding the range are read and decrypted
+	//Compressed entries are found through an index of their blocks, built from their block headers on the first read
+	//Ranges aren't checked against the entry's checksum, which covers all of it, the reader's verify() does that
+	//Each stream reads through a source of its own, so one entry can be read on several threads by giving each thread a stream
+	class FeD_EntryStream {
+	public:
+		FeD_EntryStream();
+		~FeD_EntryStream();
+
+		//References are opened as the entry they refer to, solid blocks can only be read whole
+		int open( const FeD_IndexedReader& reader, size_t i, const KeyContext& key );
+
+		//Original length of the entry, after decompression
+		uint64_t size() const { return _size; };
+		uint64_t position() const { return _position; };
+		bool seek( uint64_t position );
+		//Returns how many bytes were copied, fewer than length only at the end of the entry or on errors
+		size_t read( char* destination, size_t length );
+		bool failed() const { return _failed; };
+
+	private:
+		struct Block {
+			uint64_t originalOffset, storedOffset;
+			uint32_t originalLength, storedLength;
+		};
+
+		//Decrypts length bytes of the entry's data as stored, from position of its keystream
+		int readStored( uint64_t position, char* destination, size_t length );
+		int buildBlockIndex();
+		int readBlock( size_t block );
+
+		std::unique_ptr<EntrySource> _source;
+		unsigned char _versionByte;
+		unsigned int _index;
+		const CipherBackend* _backend;
+		char _state[cipherStateSize];
+		bool _compressed, _failed;
+		uint64_t _dataOffset, _storedLength, _size, _position;
+		std::vector<Block> _blocks;
+		//The block last decompressed, so reads going through it a piece at a time only decompress it once
+		size_t _cachedBlock;
+		std::vector<char> _blockData, _storedData;
+	};
+
+	//Yields every entry's index, path and data length in turn, without reading or decrypting any entry data
+	//v6 files are listed from their directory, older ones by seeking from one header to the next
+	class FeD_LazyReader {
+	public:
+		FeD_LazyReader();
+		~FeD_LazyReader();
+
+		int open( std::filesystem::path pathToFile, bool verboseLogging );
+
+		unsigned char version() const { return _versionByte; };
+
+		//Sets endOfEntries instead of filling in entry once every entry has been read
+		//Members of solid blocks are yielded one by one like any other entry, which takes decrypting their block's member table
+		int next( std::string key, FeD_Entry& entry, bool& endOfEntries );
+		int next( const KeyContext& key, FeD_Entry& entry, bool& endOfEntries );
+
+	private:
+		int readSolidBlock( const KeyContext& key, const FeD_Entry& block, size_t dataLength );
+
+		std::unique_ptr<EntrySource> _source;
+		unsigned char _versionByte;
+		bool _verboseLogging, _useDirectory, _finished;
+		std::vector<FeD_DirectoryEntry> _directory;
+		size_t _nextEntry;
+		std::deque<FeD_Entry> _solidMembers;
+		std::vector<char> _dataBuffer;
+	};
 }
\ No newline at end of file
@@ -0,0 +1,36 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+
+namespace FileDeen {
+
+	//Read-only view of a whole file mapped into memory, so it can be parsed in place without read() calls
+	class MappedFile {
+	public:
+		MappedFile();
+		~MappedFile();
+		MappedFile( const MappedFile& ) = delete;
+		MappedFile& operator=( const MappedFile& ) = delete;
+
+		bool open( std::filesystem::path pathToFile );
+		void close();
+		bool isOpen() const { return _data != nullptr; };
+
+		const char* data() const { return _data; };
+		uint64_t size() const { return _size; };
+
+		//Hints to the OS about how the mapping will be used, both are safe to ignore
+		void adviseSequential();
+		void adviseWillNeed( uint64_t offset, uint64_t length );
+
+	private:
+		const char* _data;
+		uint64_t _size;
+#ifdef _WIN32
+		void* _file;
+		void* _mapping;
+#else
+		int _file;
+#endif
+	};
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace FileDeen {
+
+	//Where encoding and decoding spend their time
+	//Phases are timed on every thread that runs them and added up, so with several threads they can add up to more than the run took
+	enum class Phase {
+		Scan,
+		Read,
+		KeySetup,
+		Cipher,
+		Compression,
+		Write
+	};
+	const int phaseCount = 6;
+	const char* phaseName( Phase phase );
+
+	//Nothing is counted or timed until metrics are enabled, after which every update is a relaxed atomic add
+	//Enabling them starts the clock the rates are worked out from
+	void setMetricsEnabled( bool enabled );
+	bool metricsEnabled();
+
+	//Entries are counted once they're done, bytes of original data as they go through so large entries show up while they're in progress
+	void countEntry();
+	void countBytes( uint64_t length );
+
+	//Adds the time from its construction to its destruction to a phase, costs a single load of a flag while metrics are disabled
+	class PhaseTimer {
+	public:
+		explicit PhaseTimer( Phase phase );
+		~PhaseTimer();
+		PhaseTimer( const PhaseTimer& ) = delete;
+		PhaseTimer& operator=( const PhaseTimer& ) = delete;
+
+	private:
+		Phase _phase;
+		bool _enabled;
+		std::chrono::steady_clock::time_point _start;
+	};
+
+	//Totals since metrics were enabled, key setup is taken from KeyContext::setupStats() which counts it regardless
+	struct MetricsSnapshot {
+		double seconds;
+		uint64_t entries, bytes;
+		uint64_t phaseNanoseconds[phaseCount], phaseCalls[phaseCount];
+	};
+
+	MetricsSnapshot metricsSnapshot();
+	std::string metricsJson( const MetricsSnapshot& snapshot );
+	int writeMetrics( std::filesystem::path pathToFile );
+
+	//Prints entries and bytes done so far and their rates every interval, on a thread of its own until stopped
+	class ProgressReporter {
+	public:
+		ProgressReporter();
+		~ProgressReporter();
+
+		void start( unsigned int intervalSeconds );
+		void stop();
+
+	private:
+		std::thread _thread;
+		std::mutex _mutex;
+		std::condition_variable _condition;
+		bool _stopping;
+	};
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <bitset>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace FileDeen {
+
+	//Shell style pattern matched against a whole entry path, with '/' between folders on every platform
+	//	*	any run of characters within one folder name
+	//	**	any run of characters across folders, "**/" also matches no folder at all
+	//	?	any one character other than '/'
+	//	[abc], [a-z], [!abc]	any one character in, or not in, the set
+	//A pattern that matches a folder also matches everything inside it
+	class PathGlob {
+	public:
+		explicit PathGlob( const std::string& pattern );
+
+		bool matches( const std::string& path ) const;
+		//Whether the pattern has no wildcards, so it can only ever match the one path it spells out and what's inside it
+		bool literal() const { return _literal; };
+		const std::string& pattern() const { return _pattern; };
+
+	private:
+		struct Token {
+			enum Kind { Character, Star, GlobStar } kind;
+			std::bitset<256> characters;
+		};
+
+		std::string _pattern;
+		std::vector<Token> _tokens;
+		bool _literal;
+	};
+
+	//Picks entries by path, an entry is picked if it matches any include and no exclude
+	//Every entry matches when no includes are given
+	class PathFilter {
+	public:
+		void include( const std::string& pattern );
+		void exclude( const std::string& pattern );
+
+		bool empty() const { return _includes.empty() && _excludes.empty(); };
+		bool matches( const std::filesystem::path& path ) const;
+
+		const std::vector<PathGlob>& includes() const { return _includes; };
+		const std::vector<PathGlob>& excludes() const { return _excludes; };
+
+	private:
+		std::vector<PathGlob> _includes, _excludes;
+	};
+}
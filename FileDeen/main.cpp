@@ -1,25 +1,55 @@
+#include <algorithm>
 #include <chrono>
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <random>
 #include <string>
 #include <thread>
+#ifdef _WIN32
 #include <windows.h>
+#endif
+#include "asyncfile.h"
 #include "config.h"
+#include "encoder.h"
 #include "filedeen.h"
+#include "metrics.h"
+#include "pathfilter.h"
 using namespace std;
 namespace fs = filesystem;
 
 FileDeen::Config CONFIG( L"FileDeen.ini" );
 
-const string key = CONFIG.getString( "sKey" );
-const bool keyEnabled = CONFIG.getBool( "bKeyEnabled" );
+//Loaded from FileDeen.ini, command line flags override them in batch mode
+string key = CONFIG.getString( "sKey" );
+bool keyEnabled = CONFIG.getBool( "bKeyEnabled" );
 const bool keyUncensored = CONFIG.getBool( "bKeyUncensored" );
-const bool onlyIncludeFolderContents = CONFIG.getBool( "bOnlyIncludeFolderContents" );
-const bool useRealNames = CONFIG.getBool( "bUseRealNames" );
-const bool verboseLogging = CONFIG.getBool( "bVerboseLogging" );
+bool onlyIncludeFolderContents = CONFIG.getBool( "bOnlyIncludeFolderContents" );
+bool useRealNames = CONFIG.getBool( "bUseRealNames" );
+bool compress = CONFIG.getBool( "bCompress" );
+bool deduplicate = CONFIG.getBool( "bDeduplicate" );
+int solidThresholdKB = CONFIG.getInt( "iSolidThresholdKB" );
+bool verboseLogging = CONFIG.getBool( "bVerboseLogging" );
+int streamBufferSizeKB = CONFIG.getInt( "iStreamBufferSizeKB" );
+int threadCount = CONFIG.getInt( "iThreadCount" );
+int directWriteMB = CONFIG.getInt( "iDirectWriteMB" );
+int volumeSizeMB = CONFIG.getInt( "iVolumeSizeMB" );
+
+//Batch mode only
+fs::path outputPath;
+bool quietLogging = false;
+FileDeen::PathFilter pathFilter;
+//Folders volumes are written to besides that of the output, and looked for in when reading
+vector<fs::path> volumeFolders;
+//Metrics are only collected when one of these asks for them
+fs::path statsPath;
+int progressSeconds = 0;
+//Encoding with -o - writes to this, standard output itself prints to standard error instead so messages stay out of the data
+FileDeen::AsyncFileHandle standardOutput;
 
 const unsigned char
 SIGN[8] = { 0x53, 0x30, 0x53, 0x30, 0x72, 0x7F, 0x0D, 0x54 };
@@ -27,238 +57,602 @@ SIGN[8] = { 0x53, 0x30, 0x53, 0x30, 0x72, 0x7F, 0x0D, 0x54 };
 
 mt19937_64 RNG;
 
-void EncodeFile( vector<fs::path> filePaths ) {
-
-	//Generate 3 random letters between a - z
-	uniform_int_distribution<short> dis( 0x61, 0x7A ); //a to z
-	wstring randomLetters( 3, 0x43 );
-	for ( int i = 0; i<3; i++ ) {
-		randomLetters[i] = dis( RNG );
-	}
-
-	wstring outputFileName = to_wstring( unsigned long long( time( nullptr ) ) ) + L"_" + randomLetters + L".fed";
-
-	FileDeen::FeD fedFile;
-	fedFile.setSignature( (char*)SIGN, 8 );
-
-	if ( !verboseLogging ) printf( "Reading files.." );
-
-	//Create FeD entries
-	{
-		int i = 0;
-		for ( const auto& filePath : filePaths ) {
-			if ( fs::is_directory( filePath ) ) {
-				for ( const auto& dirEntry : fs::recursive_directory_iterator( filePath ) ) {
-					if ( dirEntry.is_regular_file() ) {
-						fs::path relativePath = fs::relative( dirEntry.path(), onlyIncludeFolderContents ? filePath : filePath.parent_path() );
-						if ( verboseLogging ) wprintf( L"%ls: Creating entry...", relativePath.wstring().c_str() );
-						FileDeen::FeD_Entry entry( { (unsigned)time( NULL ) } );
-						
-						entry.setIndex( i );
-						
-						string sRelativePath( relativePath.wstring().length()*2, 0x00 );
-						memcpy( &sRelativePath[0], &relativePath.wstring()[0], relativePath.wstring().length()*2 );
-						entry.setPathPadLength( FileDeen::CBCEncrypt( sRelativePath, keyEnabled ? key : "", entry.initVector() ) );
-						entry.setPath( &sRelativePath[0], sRelativePath.length() );
-
-						fstream inputFile( dirEntry.path(), ios::in | ios::binary | ios::ate );
-						size_t length = inputFile.tellg();
-						inputFile.seekg( 0 );
-
-						std::string dataBuffer( length, 0x00 );
-						inputFile.read( &dataBuffer[0], length );
-						inputFile.close();
-						entry.setDataPadLength( FileDeen::CBCEncrypt( dataBuffer, keyEnabled ? key : "", entry.initVector() ) );
-						entry.moveData( dataBuffer );
-
-						fedFile.moveEntry( entry );
-
-						if ( verboseLogging ) printf( "Done!\n" );
-						i++;
-					}
-				}
-			}
-			else {
-				if ( verboseLogging ) wprintf( L"%ls: Creating entry...", filePath.filename().wstring().c_str() );
-				FileDeen::FeD_Entry entry( { (unsigned)time( NULL ) } );
+//Jobs come from FileDeen::scanFiles, appending adds them to the existing FeD file at outputPath instead of creating a new one
+int EncodeFile( vector<FileDeen::EncodeJob> jobs, bool append = false ) {
+
+	fs::path outputFileName = outputPath;
+	if ( outputFileName.empty() ) {
+		//Generate 3 random letters between a - z
+		uniform_int_distribution<short> dis( 0x61, 0x7A ); //a to z
+		string randomLetters( 3, 0x43 );
+		for ( int i = 0; i<3; i++ ) {
+			randomLetters[i] = (char)dis( RNG );
+		}
+		outputFileName = to_string( (unsigned long long)time( nullptr ) ) + "_" + randomLetters + ".fed";
+	}
+
+	FileDeen::FeD_Writer fedWriter( (size_t)streamBufferSizeKB*1024 );
+	fedWriter.setCompression( compress );
+	if ( volumeSizeMB > 0 ) {
+		fedWriter.setVolumes( (uint64_t)volumeSizeMB*1024*1024, volumeFolders );
+	}
+	int openResult;
+	if ( append ) {
+		openResult = fedWriter.openForAppend( outputFileName );
+	}
+	else if ( outputFileName == "-" ) {
+		openResult = fedWriter.open( standardOutput, string( (const char*)SIGN, sizeof( SIGN ) ) );
+	}
+	else {
+		openResult = fedWriter.open( outputFileName, string( (const char*)SIGN, sizeof( SIGN ) ) );
+	}
+	if ( openResult != 0 ) {
+		return 1;
+	}
 
-				entry.setIndex( i );
+	//Read and encrypt every file in parallel while they are written in order
+	FileDeen::ParallelEncoder encoder( threadCount, (size_t)streamBufferSizeKB*1024 );
+	encoder.setCompression( compress );
+	encoder.setSolidThreshold( (uint64_t)solidThresholdKB*1024 );
+	if ( deduplicate ) {
+		size_t duplicates = encoder.findDuplicates( jobs );
+		if ( verboseLogging ) printf( "Found %zu duplicate files\n", duplicates );
+	}
+	if ( !quietLogging ) printf( "Writing to \'%s\' using %u threads...", outputFileName.u8string().c_str(), encoder.threadCount() );
+	if ( verboseLogging ) printf( "\n" );
+	FileDeen::KeyContext keyContext( keyEnabled ? key : "" );
+	int result = encoder.encode( jobs, fedWriter, keyContext, verboseLogging );
 
-				fs::path relativePath = fs::relative( filePath, filePath.parent_path() ).string();
-				string sRelativePath( relativePath.wstring().length()*2, 0x00 );
-				memcpy( &sRelativePath[0], &relativePath.wstring()[0], relativePath.wstring().length()*2 );
-				entry.setPathPadLength( FileDeen::CBCEncrypt( sRelativePath, keyEnabled ? key : "", entry.initVector() ) );
-				entry.setPath( &sRelativePath[0], sRelativePath.length() );
+	result |= fedWriter.close();
+	if ( !quietLogging ) printf( result == 0 ? "Done!\n" : "Failed!\n" );
 
-				fstream inputFile( filePath, ios::in | ios::binary | ios::ate );
-				size_t length = inputFile.tellg();
-				inputFile.seekg( 0 );
+	return result;
+}
 
-				std::string dataBuffer( length, 0x00 );
-				inputFile.read( &dataBuffer[0], length );
-				inputFile.close();
-				entry.setDataPadLength( FileDeen::CBCEncrypt( dataBuffer, keyEnabled ? key : "", entry.initVector() ) );
-				entry.moveData( dataBuffer );
+//Writes each decoded entry to its own file as its data arrives
+//Writes finish in the background while the next entries are decoded, finish() waits for the last of them
+//Writers on different threads share the folders they have created through folders
+class EntryFileWriter : public FileDeen::FeD_EntryVisitor {
+public:
+	EntryFileWriter( fs::path rootFolder, FileDeen::DirectoryCache& folders, const FileDeen::FeD_IndexedReader* reader = nullptr ) :
+		_rootFolder( rootFolder ), _folders( folders ), _reader( reader ), _entriesWritten( 0 ), _outsideRoot( false ), _failed( false ) {};
+
+	//Entries a later one is stored over are left out when decoding to real names, so no two writers ever write the same file
+	bool wantsEntry( const FileDeen::FeD_Entry& entry ) override {
+		return pathFilter.matches( entry.path() ) && (!useRealNames || _reader == nullptr || _reader->latestUnderPath( entry ));
+	}
 
-				fedFile.moveEntry( entry );
+	void beginEntry( const FileDeen::FeD_Entry& entry ) override {
+		FileDeen::PhaseTimer timer( FileDeen::Phase::Write );
+		_outputFileName = entry.outputPath( _rootFolder, useRealNames );
+		//Its data is still read through, but goes nowhere
+		_outsideRoot = _outputFileName.empty();
+		if ( _outsideRoot ) {
+			printf( "Error: Entry %u has a path outside the folder it's decoded to\n", entry.index() );
+			_failed = true;
+			_entriesWritten++;
+			return;
+		}
+		_folders.create( _outputFileName.parent_path() );
+		bool direct = directWriteMB > 0 && entry.dataLength() >= (uint64_t)directWriteMB*1024*1024;
+		if ( !_outputFile.open( _outputFileName, true, direct ) ) {
+			printf( "Error: Could not open \'%s\' for writing\n", _outputFileName.u8string().c_str() );
+			_failed = true;
+		}
+		_outputFile.preallocate( entry.dataLength() );
+		_entriesWritten++;
+	}
 
-				if ( verboseLogging ) printf( "Done!\n" );
-				i++;
-			}
+	void entryData( const FileDeen::FeD_Entry&, const char* data, size_t length ) override {
+		if ( _outsideRoot ) {
+			return;
 		}
+		FileDeen::PhaseTimer timer( FileDeen::Phase::Write );
+		_outputFile.write( data, length );
 	}
 
-	if ( !verboseLogging ) printf( "Done!\n" );
+	//Printed in one go once the entry is done, so lines from different threads don't run into each other
+	void endEntry( const FileDeen::FeD_Entry& entry ) override {
+		if ( _outsideRoot ) {
+			return;
+		}
+		bool written;
+		{
+			FileDeen::PhaseTimer timer( FileDeen::Phase::Write );
+			written = _outputFile.close() == 0;
+		}
+		if ( !written ) {
+			_failed = true;
+		}
+		else if ( !quietLogging ) {
+			printf( "%.3u: Writing to \'%s\'...Done!\n", entry.index(), _outputFileName.u8string().c_str() );
+		}
+	}
 
-	//Write data
-	wprintf( L"Writing to \'%ls\'...", outputFileName.c_str() );
-	fedFile.writeToFile( outputFileName );
-	printf( "Done!\n" );
+	void finish() {
+		if ( _outputFile.finish() != 0 ) {
+			printf( "Error: Could not write every decoded file\n" );
+			_failed = true;
+		}
+	}
 
-	return;
+	size_t entriesWritten() const { return _entriesWritten; };
+	bool failed() const { return _failed; };
+
+private:
+	fs::path _rootFolder, _outputFileName;
+	FileDeen::DirectoryCache& _folders;
+	const FileDeen::FeD_IndexedReader* _reader;
+	FileDeen::AsyncFileWriter _outputFile;
+	size_t _entriesWritten;
+	bool _outsideRoot, _failed;
+};
+
+//Paths given without wildcards are looked up in the directory, so only the entries holding them are read at all
+//Every entry is picked otherwise, which includes when a path isn't found because it's that of a folder
+vector<size_t> PickEntries( FileDeen::FeD_IndexedReader& reader, const FileDeen::KeyContext& keyContext ) {
+	vector<size_t> entries;
+	const auto& includes = pathFilter.includes();
+	if ( !includes.empty() && none_of( includes.begin(), includes.end(), []( const FileDeen::PathGlob& glob ) { return !glob.literal(); } ) ) {
+		for ( const auto& glob : includes ) {
+			size_t i;
+			if ( !reader.findEntry( fs::u8path( glob.pattern() ), keyContext, i ) ) {
+				entries.clear();
+				break;
+			}
+			entries.push_back( i );
+		}
+		//Members of the same solid block are all decoded with it
+		sort( entries.begin(), entries.end() );
+		entries.erase( unique( entries.begin(), entries.end() ), entries.end() );
+	}
+	if ( entries.empty() ) {
+		entries.resize( reader.numEntries() );
+		for ( size_t i = 0; i < entries.size(); i++ ) {
+			entries[i] = i;
+		}
+	}
+	return entries;
 }
 
-void DecodeFile( fs::path filePath ) {
-
-	FileDeen::FeD fedFile;
+//v6 files are decoded on threadCount threads, each reading entries through a source of its own and writing them out itself
+//Older files have no directory to hand entries out from, so they're decoded in order on this thread
+//Files split into volumes are decoded as one, with every thread reading from whichever volume holds the entry it's on
+//Entries the path filter turns down are skipped over without being decrypted
+//A file path of - decodes standard input in order on this thread, as it arrives
+int DecodeFile( fs::path filePath ) {
+
+	fs::path rootFolder = outputPath.empty() ? filePath.stem() : outputPath;
+	FileDeen::KeyContext keyContext( key );
+	FileDeen::DirectoryCache folders;
+	vector<unique_ptr<EntryFileWriter>> entryWriters;
+
+	vector<fs::path> volumes;
+	unsigned char versionByte = 0;
+	if ( filePath != "-" && (FileDeen::findVolumes( filePath, volumeFolders, volumes ) != 0 || FileDeen::readVersion( volumes[0], versionByte ) != 0) ) {
+		return 1;
+	}
+	FileDeen::FeD_IndexedReader reader;
+	int result;
+	if ( filePath == "-" ) {
+		FileDeen::FeD fedFile;
+		entryWriters.push_back( make_unique<EntryFileWriter>( rootFolder, folders ) );
+		result = fedFile.readFromInput( keyContext, verboseLogging, *entryWriters.back(), (size_t)streamBufferSizeKB*1024 );
+	}
+	else if ( versionByte >= 0x06 && versionByte <= FileDeen::formatVersion && reader.open( volumes, verboseLogging ) == 0 ) {
+		vector<size_t> entries = PickEntries( reader, keyContext );
+		if ( useRealNames ) {
+			reader.buildPathIndex( keyContext );
+		}
+		unsigned int threads = threadCount > 0 ? (unsigned int)threadCount : max( thread::hardware_concurrency(), 1u );
+		threads = (unsigned int)min<size_t>( threads, max<size_t>( entries.size(), 1 ) );
+		vector<FileDeen::FeD_EntryVisitor*> visitors;
+		for ( unsigned int i = 0; i < threads; i++ ) {
+			entryWriters.push_back( make_unique<EntryFileWriter>( rootFolder, folders, &reader ) );
+			visitors.push_back( entryWriters.back().get() );
+		}
+		if ( verboseLogging ) printf( "Decoding %zu entries using %u threads\n", entries.size(), threads );
+		result = reader.readEntries( entries, keyContext, visitors, (size_t)streamBufferSizeKB*1024 );
+	}
+	else if ( volumes.size() > 1 ) {
+		return 1;
+	}
+	else {
+		FileDeen::FeD fedFile;
+		entryWriters.push_back( make_unique<EntryFileWriter>( rootFolder, folders ) );
+		result = fedFile.readFromFile( filePath, keyContext, verboseLogging, *entryWriters.back(), (size_t)streamBufferSizeKB*1024 );
+	}
 
-	fstream inputFile;
-	inputFile.open( filePath, fstream::in | fstream::binary );
+	size_t entriesWritten = 0;
+	bool failed = false;
+	for ( auto& entryWriter : entryWriters ) {
+		entryWriter->finish();
+		entriesWritten += entryWriter->entriesWritten();
+		failed = failed || entryWriter->failed();
+	}
+	if ( result == 0 && !pathFilter.includes().empty() && entriesWritten == 0 ) {
+		printf( "Error: No entries match the given paths\n" );
+		return 1;
+	}
+	return result != 0 || failed ? 1 : 0;
+}
 
-	string buffer;
+//Prints one line per entry with its index, data length and path separated by tabs
+//Only headers are read, so this costs the same for a 1KB file as for a 100GB one
+//Files split into volumes are listed one volume after another
+int ListFile( fs::path filePath ) {
 
-	//Check signature
-	buffer.resize( sizeof( SIGN ) );
-	if ( verboseLogging ) printf( "Checking signature..." );
-	inputFile.read( &buffer[0], sizeof( SIGN ) );
-	if ( memcmp( &buffer[0], SIGN, sizeof( SIGN ) ) != NULL ) {
-		printf( "Error: File is not a FeD file\n" );
-		return;
+	vector<fs::path> volumes;
+	if ( FileDeen::findVolumes( filePath, volumeFolders, volumes ) != 0 ) {
+		return 1;
 	}
-	fedFile.setSignature( &buffer[0], sizeof( SIGN ) );
-	if ( verboseLogging ) printf( "Done!\n" );
 
-	//Check version
-	if ( verboseLogging ) printf( "Checking version..." );
-	unsigned char versionByte = inputFile.peek();
-	if ( versionByte != fedFile.version() ) {
-		short nextTwoBytes;
-		inputFile.read( (char*)&nextTwoBytes, sizeof( nextTwoBytes ) );
-		inputFile.seekg( -(signed)sizeof( nextTwoBytes ), ios::cur );
-		if ( nextTwoBytes % 2 == 0 && nextTwoBytes <= 512 ) {
-			printf( "Error:	FeD file was encoded before version checking was added.\nComplete decoding is not guaranteed\n" );
-		}
-		else if ( versionByte < fedFile.version() ) {
-			printf( "Error: FeD file was encoded with past encoding scheme \'v%u\', whereas the current decoding scheme is \'v%u\'.\nComplete decoding is not guaranteed\n", versionByte, fedFile.version() );
-			inputFile.seekg( 1, ios::cur );
-		}
-		else if ( versionByte > fedFile.version() ) {
-			printf( "Error: FeD file was encoded with future encoding scheme \'v%u\', whereas the current decoding scheme is \'v%u\'.\nComplete decoding is not guaranteed.\n", versionByte, fedFile.version() );
-			inputFile.seekg( 1, ios::cur );
+	FileDeen::KeyContext keyContext( key );
+	FileDeen::FeD_Entry entry;
+	unsigned long long entryCount = 0, totalLength = 0;
+	for ( const auto& volume : volumes ) {
+		FileDeen::FeD_LazyReader reader;
+		if ( reader.open( volume, verboseLogging ) != 0 ) {
+			return 1;
 		}
-		printf( "Do you wish to continue? (y/n): " );
-		if ( getchar() == 'n' ) {
-			cin.ignore();
-			return;
+		while ( true ) {
+			bool endOfEntries;
+			if ( reader.next( keyContext, entry, endOfEntries ) != 0 ) {
+				return 1;
+			}
+			if ( endOfEntries ) {
+				break;
+			}
+			if ( !pathFilter.matches( entry.path() ) ) {
+				continue;
+			}
+			printf( "%u\t%zu\t%s\n", entry.index(), entry.dataLength(), entry.path().u8string().c_str() );
+			entryCount++;
+			totalLength += entry.dataLength();
 		}
-		else {
-			cin.ignore();
+	}
+	if ( verboseLogging ) printf( "%llu entries, %llu bytes\n", entryCount, totalLength );
+	return 0;
+}
+
+//Counts the entries read through it and drops their data, for reading a file through only to see that it can be
+class EntryCounter : public FileDeen::FeD_EntryVisitor {
+public:
+	void beginEntry( const FileDeen::FeD_Entry& ) override {};
+	void entryData( const FileDeen::FeD_Entry&, const char*, size_t ) override {};
+	void endEntry( const FileDeen::FeD_Entry& ) override { _entries++; };
+
+	size_t entries() const { return _entries; };
+
+private:
+	size_t _entries = 0;
+};
+
+//Decrypts and checks every entry on every thread, without writing anything
+//Files older than v6 have no directory to hand entries out from, so they're read through in order on this thread, which stops at the first entry that can't be read
+int VerifyFile( fs::path filePath ) {
+	vector<fs::path> volumes;
+	unsigned char versionByte = 0;
+	if ( FileDeen::findVolumes( filePath, volumeFolders, volumes ) != 0 || FileDeen::readVersion( volumes[0], versionByte ) != 0 ) {
+		return 1;
+	}
+	if ( versionByte < 0x08 && !quietLogging ) {
+		printf( "FeD file \'v%u\' has no checksums, only its structure can be verified\n", versionByte );
+	}
+
+	FileDeen::KeyContext keyContext( key );
+	if ( versionByte < 0x06 ) {
+		FileDeen::FeD fedFile;
+		EntryCounter counter;
+		if ( fedFile.readFromFile( filePath, keyContext, verboseLogging, counter, (size_t)streamBufferSizeKB*1024 ) != 0 ) {
+			printf( "Error: Verification failed after %zu entries\n", counter.entries() );
+			return 1;
 		}
+		if ( !quietLogging ) printf( "Verified %zu entries\n", counter.entries() );
+		return 0;
+	}
+
+	FileDeen::FeD_IndexedReader reader;
+	if ( reader.open( volumes, verboseLogging ) != 0 ) {
+		return 1;
+	}
+	size_t failedEntries;
+	int result = reader.verify( keyContext, threadCount, failedEntries, (size_t)streamBufferSizeKB*1024 );
+	if ( result == 0 ) {
+		if ( !quietLogging ) printf( "Verified %zu entries\n", reader.numEntries() );
 	}
 	else {
-		if ( verboseLogging ) printf( "Done!: \'v%u\'\n", versionByte );
-		inputFile.seekg( 1, ios::cur );
+		printf( "Error: %zu of %zu entries failed verification\n", failedEntries, reader.numEntries() );
 	}
+	return result;
+}
 
-	while ( true ) {
-		FileDeen::FeD_Entry entry( { (unsigned)time( NULL ) } );
+void PrintUsage() {
+	printf( "Usage: FileDeen <command> [options] <paths...>\n"
+		"       FileDeen [paths...]  Pick a mode interactively\n"
+		"\n"
+		"Commands:\n"
+		"  encode <paths...>       Encode files and folders into a new FeD file\n"
+		"  append <paths...>       Add files and folders to the end of the FeD file given with -o\n"
+		"  decode <file>           Decode a FeD file, or standard input if the file is -\n"
+		"  list <file>             List the entries of a FeD file without decoding them\n"
+		"  verify <file>           Check every entry of a FeD file against its checksum without decoding it\n"
+		"\n"
+		"Options:\n"
+		"  -o, --output <path>     FeD file to write, or folder to decode into, - encodes to standard output\n"
+		"  -k, --key <key>         Key to encode or decode with\n"
+		"      --key-file <path>   Read the key from the first line of a file\n"
+		"      --key-env <name>    Read the key from an environment variable\n"
+		"      --no-key            Don't use a key\n"
+		"  -t, --threads <count>   Worker threads, 0 uses every hardware thread\n"
+		"  -b, --buffer <KB>       Stream buffer size in KB\n"
+		"      --compress          Compress entries that look compressible before encrypting them\n"
+		"      --no-compress       Store every entry uncompressed\n"
+		"      --dedup             Store identical files once, later copies refer back to the first\n"
+		"      --no-dedup          Store every file in full\n"
+		"      --solid <KB>        Pack files no larger than this into shared entries, 0 stores every file on its own\n"
+		"      --volume-size <MB>  Split the FeD file into volumes of this size, an entry too large for one goes over it and fails, 0 writes a single file\n"
+		"      --volume-dir <path> Also write volumes to this folder, created if needed, at the same time, or look for them there, may be given more than once\n"
+		"      --contents          Store only the contents of folders, not the folders themselves\n"
+		"      --real-names        Decode entries to their real names instead of their indices\n"
+		"      --direct <MB>       Decode entries at least this large straight to disk, bypassing the OS cache, 0 never does\n"
+		"      --include <glob>    Only decode or list entries whose path matches, may be given more than once\n"
+		"      --exclude <glob>    Skip entries whose path matches, may be given more than once\n"
+		"      --stats <path>      Write entry and byte counts, rates and time spent in each phase to a JSON file when done\n"
+		"      --progress <sec>    Print entries and bytes done so far every this many seconds, 0 never does\n"
+		"  -f, --force             Decode files with a mismatched version instead of failing\n"
+		"  -q, --quiet             Only print errors\n"
+		"  -v, --verbose           Print every step\n"
+		"\n"
+		"Options not given are taken from FileDeen.ini. Exit code is 0 on success, 1 on failure and 2 on bad usage\n" );
+}
 
-		//Read index
-		buffer.resize( sizeof( entry.index() ) );
-		if ( verboseLogging ) printf( "Reading index..." );
-		inputFile.read( &buffer[0], buffer.size() );
-		entry.setIndex( &buffer[0], buffer.size() );
-		if ( verboseLogging && entry.index() != 0xFFFFFFFF ) printf( "Done!: %.3u\n", entry.index() );
+bool ReadEnvironment( const string& name, string& value ) {
+#ifdef _WIN32
+	char* buffer = nullptr;
+	size_t length = 0;
+	if ( _dupenv_s( &buffer, &length, name.c_str() ) != 0 || buffer == nullptr ) {
+		return false;
+	}
+	value = buffer;
+	free( buffer );
+#else
+	const char* buffer = getenv( name.c_str() );
+	if ( buffer == nullptr ) {
+		return false;
+	}
+	value = buffer;
+#endif
+	return true;
+}
 
-		if ( entry.index() == 0xFFFFFFFF ) {
-			if ( verboseLogging ) printf( "End of file found\n" );
-			inputFile.close();
-			break;
+//Runs a known command on the paths given to it
+int RunFiles( const string& command, const vector<fs::path>& filePaths ) {
+	if ( command == "encode" || command == "append" ) {
+		if ( command == "append" && outputPath.empty() ) {
+			printf( "Error: append needs the FeD file to add to, given with -o\n" );
+			return 2;
 		}
+		//Copies of files can't be stored as references, standard input can't go back to the entry they refer to when it's decoded
+		if ( outputPath == "-" ) {
+			if ( command == "append" ) {
+				printf( "Error: Standard output can't be appended to\n" );
+				return 2;
+			}
+			standardOutput = FileDeen::takeStandardOutput();
+			deduplicate = false;
+		}
+		vector<FileDeen::EncodeJob> jobs;
+		if ( FileDeen::scanFiles( filePaths, onlyIncludeFolderContents, threadCount, jobs ) != 0 ) {
+			return 1;
+		}
+		return EncodeFile( jobs, command == "append" );
+	}
+	if ( filePaths.size() > 1 ) {
+		printf( "Error: Only one file can be %s at a time\n", command == "decode" ? "decoded" : command == "list" ? "listed" : "verified" );
+		return 2;
+	}
+	if ( filePaths[0] == "-" && command != "decode" ) {
+		printf( "Error: Standard input can only be decoded\n" );
+		return 2;
+	}
+	if ( filePaths[0] == "-" && outputPath.empty() ) {
+		printf( "Error: Decoding standard input needs the folder to decode into, given with -o\n" );
+		return 2;
+	}
+	if ( command == "verify" ) {
+		return VerifyFile( filePaths[0] );
+	}
+	return command == "decode" ? DecodeFile( filePaths[0] ) : ListFile( filePaths[0] );
+}
 
-		//Read initialization vector
-		std::vector<char> initVector( FileDeen::blockSize );
-		if ( verboseLogging ) printf( "Reading initialization vector..." );
-		inputFile.read( &initVector[0], initVector.size() );
-		entry.setInitVector( initVector );
-		if ( verboseLogging ) printf( "Done!\n" );
-
-		//Read path size
-		unsigned short pathLength;
-		if ( verboseLogging ) printf( "%.3u: Reading path length...", entry.index() );
-		inputFile.read( (char*)&pathLength, sizeof( pathLength ) );
-		if ( verboseLogging ) printf( "Done!: %hu\n", pathLength );
-
-		//Read path padding size
-		unsigned short pathPadLength;
-		if ( verboseLogging ) printf( "%.3u: Reading path padding length...", entry.index() );
-		inputFile.read( (char*)&pathPadLength, sizeof( pathPadLength ) );
-		if ( verboseLogging ) printf( "Done!: %hu\n", pathPadLength );
-
-		//Read path
-		buffer.resize( pathLength );
-		if ( verboseLogging ) printf( "%.3u: Reading path...", entry.index() );
-		inputFile.read( &buffer[0], buffer.size() );
-		FileDeen::CBCDecrypt( buffer, key, entry.initVector() );
-		buffer.resize( buffer.size()-pathPadLength );
-		entry.setPath( &buffer[0], buffer.size() );
-		if ( verboseLogging ) printf( "Done!\n" );
-
-		//Read data length
-		size_t dataLength;
-		if ( verboseLogging ) printf( "%.3u: Reading data length...", entry.index() );
-		inputFile.read( (char*)&dataLength, sizeof( dataLength ) );
-		if ( verboseLogging ) printf( "Done!: %zu\n", dataLength );
-
-		//Read data padding size
-		unsigned short dataPadLength;
-		if ( verboseLogging ) printf( "%.3u: Reading data padding length...", entry.index() );
-		inputFile.read( (char*)&dataPadLength, sizeof( dataPadLength ) );
-		if ( verboseLogging ) printf( "Done!: %hu\n", dataPadLength );
-
-		//Read data
-		buffer.resize( dataLength );
-		if ( verboseLogging ) printf( "%.3u: Reading data...", entry.index() );
-		inputFile.read( &buffer[0], buffer.size() );
-		FileDeen::CBCDecrypt( buffer, key, entry.initVector() );
-		buffer.resize( buffer.size()-dataPadLength );
-		entry.moveData( buffer );
-		if ( verboseLogging ) printf( "Done!\n" );
-
-		//Write data
-		fs::path outputFileName;
-		if ( useRealNames ) {
-			outputFileName = filePath.stem().wstring() + L"\\" + entry.path().wstring();
+//Non-interactive mode for scripts, never prompts or waits
+int RunCommand( const vector<string>& args ) {
+	string command = args[0];
+	if ( command == "help" || command == "-h" || command == "--help" ) {
+		PrintUsage();
+		return 0;
+	}
+	FileDeen::setVersionMismatch( FileDeen::VersionMismatch::Refuse );
+
+	vector<fs::path> filePaths;
+	for ( size_t i = 1; i < args.size(); i++ ) {
+		const string& arg = args[i];
+		bool hasValue = i+1 < args.size();
+		auto isOption = [&]( const char* shortName, const char* longName ) {
+			return (shortName != nullptr && arg == shortName) || arg == longName;
+		};
+		auto needsValue = [&]() {
+			if ( !hasValue ) {
+				printf( "Error: %s needs a value\n", arg.c_str() );
+			}
+			return hasValue;
+		};
+
+		if ( isOption( "-o", "--output" ) ) {
+			if ( !needsValue() ) return 2;
+			outputPath = fs::u8path( args[++i] );
+		}
+		else if ( isOption( "-k", "--key" ) ) {
+			if ( !needsValue() ) return 2;
+			key = args[++i];
+			keyEnabled = true;
+		}
+		else if ( isOption( nullptr, "--key-file" ) ) {
+			if ( !needsValue() ) return 2;
+			fs::path keyFile = fs::u8path( args[++i] );
+			fstream keyInput( keyFile, ios::in );
+			if ( !keyInput ) {
+				printf( "Error: Could not open \'%s\'\n", keyFile.u8string().c_str() );
+				return 1;
+			}
+			getline( keyInput, key );
+			if ( !key.empty() && key.back() == '\r' ) {
+				key.pop_back();
+			}
+			keyEnabled = true;
+		}
+		else if ( isOption( nullptr, "--key-env" ) ) {
+			if ( !needsValue() ) return 2;
+			if ( !ReadEnvironment( args[++i], key ) ) {
+				printf( "Error: Environment variable \'%s\' is not set\n", args[i].c_str() );
+				return 1;
+			}
+			keyEnabled = true;
+		}
+		else if ( isOption( nullptr, "--no-key" ) ) {
+			key.clear();
+			keyEnabled = false;
+		}
+		else if ( isOption( "-t", "--threads" ) || isOption( "-b", "--buffer" ) || isOption( nullptr, "--solid" ) || isOption( nullptr, "--direct" ) ||
+			isOption( nullptr, "--volume-size" ) || isOption( nullptr, "--progress" ) ) {
+			if ( !needsValue() ) return 2;
+			char* end;
+			long value = strtol( args[++i].c_str(), &end, 10 );
+			if ( *end != '\0' || end == args[i].c_str() || value < 0 || value > 1024*1024 ) {
+				printf( "Error: Invalid value for %s: \'%s\'\n", arg.c_str(), args[i].c_str() );
+				return 2;
+			}
+			if ( isOption( "-t", "--threads" ) ) {
+				threadCount = (int)value;
+			}
+			else if ( isOption( nullptr, "--solid" ) ) {
+				solidThresholdKB = (int)value;
+			}
+			else if ( isOption( nullptr, "--direct" ) ) {
+				directWriteMB = (int)value;
+			}
+			else if ( isOption( nullptr, "--volume-size" ) ) {
+				volumeSizeMB = (int)value;
+			}
+			else if ( isOption( nullptr, "--progress" ) ) {
+				progressSeconds = (int)value;
+			}
+			else {
+				streamBufferSizeKB = max( (int)value, 1 );
+			}
+		}
+		else if ( isOption( nullptr, "--compress" ) ) {
+			compress = true;
+		}
+		else if ( isOption( nullptr, "--no-compress" ) ) {
+			compress = false;
+		}
+		else if ( isOption( nullptr, "--dedup" ) ) {
+			deduplicate = true;
+		}
+		else if ( isOption( nullptr, "--no-dedup" ) ) {
+			deduplicate = false;
+		}
+		else if ( isOption( nullptr, "--contents" ) ) {
+			onlyIncludeFolderContents = true;
+		}
+		else if ( isOption( nullptr, "--real-names" ) ) {
+			useRealNames = true;
+		}
+		else if ( isOption( nullptr, "--include" ) || isOption( nullptr, "--exclude" ) ) {
+			if ( !needsValue() ) return 2;
+			if ( isOption( nullptr, "--include" ) ) {
+				pathFilter.include( args[++i] );
+			}
+			else {
+				pathFilter.exclude( args[++i] );
+			}
+		}
+		else if ( isOption( nullptr, "--volume-dir" ) ) {
+			if ( !needsValue() ) return 2;
+			volumeFolders.push_back( fs::u8path( args[++i] ) );
+		}
+		else if ( isOption( nullptr, "--stats" ) ) {
+			if ( !needsValue() ) return 2;
+			statsPath = fs::u8path( args[++i] );
+		}
+		else if ( isOption( "-f", "--force" ) ) {
+			FileDeen::setVersionMismatch( FileDeen::VersionMismatch::Continue );
+		}
+		else if ( isOption( "-q", "--quiet" ) ) {
+			quietLogging = true;
+			verboseLogging = false;
+		}
+		else if ( isOption( "-v", "--verbose" ) ) {
+			verboseLogging = true;
+			quietLogging = false;
+		}
+		else if ( arg.size() > 1 && arg[0] == '-' ) {
+			printf( "Error: Unknown option \'%s\'\n", arg.c_str() );
+			return 2;
 		}
 		else {
-			outputFileName = filePath.stem().wstring() + L"\\" + entry.path().parent_path().wstring() + L"\\" + to_wstring( entry.index() ) + entry.path().extension().wstring();
+			filePaths.push_back( fs::u8path( arg ) );
 		}
-		fs::create_directories( outputFileName.parent_path() );
-		wprintf( L"%.3u: Writing to \'%ls\'...", entry.index(), outputFileName.c_str() );
-		entry.writeDataToFile( outputFileName );
-		printf( "Done!\n" );
 	}
-	return;
-}
 
-int wmain( int argc, wchar_t* argv[] ) {
+	//Decoding can't honour a key that was only set in the config file but left disabled
+	if ( !keyEnabled ) {
+		key.clear();
+	}
 
-	SetConsoleTitleW( L"FileDeen | Encoding Scheme: v5" );
+	if ( filePaths.empty() ) {
+		printf( "Error: No files given\n" );
+		return 2;
+	}
+	//Files split into volumes are given by the name they were split from, their first volume is always in the same folder
+	for ( const auto& path : filePaths ) {
+		if ( path != "-" && !fs::is_regular_file( path ) && !fs::is_directory( path ) && !fs::is_regular_file( FileDeen::volumePath( path.parent_path(), path.filename(), 1 ) ) ) {
+			printf( "Error: \'%s\' does not exist or is unsupported\n", path.u8string().c_str() );
+			return 1;
+		}
+	}
 
-	RNG.seed( (unsigned)time( NULL ) );
+	if ( command != "encode" && command != "append" && command != "decode" && command != "list" && command != "verify" ) {
+		printf( "Error: Unknown command \'%s\'\n", command.c_str() );
+		PrintUsage();
+		return 2;
+	}
+
+	//The clock starts before scanning, so the rates cover the whole command
+	FileDeen::ProgressReporter progress;
+	if ( !statsPath.empty() || progressSeconds > 0 ) {
+		FileDeen::setMetricsEnabled( true );
+		progress.start( progressSeconds );
+	}
+	int result = RunFiles( command, filePaths );
+	progress.stop();
+	if ( !statsPath.empty() ) {
+		result = max( result, FileDeen::writeMetrics( statsPath ) );
+	}
+	return result;
+}
+
+//Original drag and drop mode, asks which mode to use and pauses before exiting
+int RunInteractive( const vector<string>& args ) {
+
+#ifdef _WIN32
+	SetConsoleTitleW( (L"FileDeen | Encoding Scheme: v" + to_wstring( FileDeen::formatVersion )).c_str() );
+#endif
 
 	vector<fs::path> filePaths;
-	if ( argc < 2 ) {
+	if ( args.empty() ) {
 		fs::path filePath;
 		while ( true ) {
 			string buffer;
@@ -273,32 +667,30 @@ int wmain( int argc, wchar_t* argv[] ) {
 		filePaths.push_back( filePath );
 	}
 	else {
-		for ( int i = 1; i<argc; i++ ) {
-			filePaths.push_back( argv[i] );
+		for ( const auto& arg : args ) {
+			filePaths.push_back( fs::u8path( arg ) );
 		}
 	}
 	
-	size_t approximateSize = FileDeen::metadataSize;
 	for ( auto it = filePaths.begin(); it!=filePaths.end(); ) {
 		fs::path path = *it;
 		if ( !fs::is_regular_file( path ) && !fs::is_directory( path ) ) {
 			cout << "Error: " << path << " does not exist or is unsupported. It will not be encoded." << endl;
 			it = filePaths.erase( it );
 		}
-		else if ( fs::is_directory( path ) ) {
-			for ( const auto& entry : fs::recursive_directory_iterator( path ) ) {
-				if ( entry.is_regular_file() ) {
-					approximateSize += fs::file_size( entry ) + FileDeen::entryMaxMetadataSize;
-				}
-			}
-			it++;
-		}
 		else {
-			approximateSize += fs::file_size( path ) + FileDeen::entryMaxMetadataSize;
 			it++;
 		}
 	}
 
+	//One walk over every folder gives both the size estimate and the files to encode
+	vector<FileDeen::EncodeJob> jobs;
+	FileDeen::scanFiles( filePaths, onlyIncludeFolderContents, threadCount, jobs );
+	size_t approximateSize = FileDeen::metadataSize;
+	for ( const auto& job : jobs ) {
+		approximateSize += job.size + FileDeen::entryMaxMetadataSize;
+	}
+
 	double approximateSizeConverted = (double)approximateSize;
 	int sizeUsed = 0;
 	string sizes[4] = { " bytes", "KB", "MB", "GB" };
@@ -332,18 +724,24 @@ int wmain( int argc, wchar_t* argv[] ) {
 		" (D) Decode\n",
 		approximateSizeConverted, sizes[sizeUsed].c_str());
 
+	int result = 0;
 	switch ( tolower( getchar() ) ) {
 		case 'e':
 			cin.ignore();
-			EncodeFile( filePaths );
+			result = EncodeFile( jobs );
 			break;
 		case 'd':
 			cin.ignore();
-			DecodeFile( filePaths[0] );
+			result = DecodeFile( filePaths[0] );
 			break;
 	}
 	printf( "All done!\n" );
 
+	if ( verboseLogging ) {
+		FileDeen::KeySetupStats keySetup = FileDeen::KeyContext::setupStats();
+		printf( "Key setups: %llu, %.3fms total\n", (unsigned long long)keySetup.count, keySetup.nanoseconds / 1000000. );
+	}
+
 	if ( verboseLogging ) {
 		printf( "Press any key to exit\n" );
 		getchar();
@@ -351,5 +749,33 @@ int wmain( int argc, wchar_t* argv[] ) {
 	else {
 		this_thread::sleep_for( 1.5s );
 	}
-	return 0;
-}
\ No newline at end of file
+	return result;
+}
+
+int Run( const vector<string>& args ) {
+	RNG.seed( (unsigned)time( NULL ) );
+
+	const char* commands[] = { "encode", "append", "decode", "list", "verify", "help", "-h", "--help" };
+	for ( const char* command : commands ) {
+		if ( !args.empty() && args[0] == command ) {
+			return RunCommand( args );
+		}
+	}
+	return RunInteractive( args );
+}
+
+//Arguments are passed on as UTF-8 on every platform
+#ifdef _WIN32
+int wmain( int argc, wchar_t* argv[] ) {
+	SetConsoleOutputCP( CP_UTF8 );
+	vector<string> args;
+	for ( int i = 1; i<argc; i++ ) {
+		args.push_back( fs::path( argv[i] ).u8string() );
+	}
+	return Run( args );
+}
+#else
+int main( int argc, char* argv[] ) {
+	return Run( vector<string>( argv+1, argv+argc ) );
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,120 @@
+#include <algorithm>
+#include "mappedfile.h"
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+using namespace FileDeen;
+
+#ifdef _WIN32
+MappedFile::MappedFile() : _data( nullptr ), _size( 0 ), _file( INVALID_HANDLE_VALUE ), _mapping( nullptr ) {
+}
+#else
+MappedFile::MappedFile() : _data( nullptr ), _size( 0 ), _file( -1 ) {
+}
+#endif
+
+MappedFile::~MappedFile() {
+	this->close();
+}
+
+//Fails for empty files and for files too large for the address space, callers should fall back to regular reads
+bool MappedFile::open( std::filesystem::path fileName ) {
+	this->close();
+#ifdef _WIN32
+	_file = CreateFileW( fileName.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr );
+	if ( _file == INVALID_HANDLE_VALUE ) {
+		return false;
+	}
+	LARGE_INTEGER fileSize;
+	if ( !GetFileSizeEx( _file, &fileSize ) || fileSize.QuadPart == 0 || (uint64_t)fileSize.QuadPart > SIZE_MAX ) {
+		this->close();
+		return false;
+	}
+	_mapping = CreateFileMappingW( _file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+	if ( _mapping == nullptr ) {
+		this->close();
+		return false;
+	}
+	_data = (const char*)MapViewOfFile( _mapping, FILE_MAP_READ, 0, 0, 0 );
+	if ( _data == nullptr ) {
+		this->close();
+		return false;
+	}
+	_size = fileSize.QuadPart;
+#else
+	_file = ::open( fileName.c_str(), O_RDONLY );
+	if ( _file < 0 ) {
+		return false;
+	}
+	struct stat fileStat;
+	if ( fstat( _file, &fileStat ) != 0 || fileStat.st_size == 0 || (uint64_t)fileStat.st_size > SIZE_MAX ) {
+		this->close();
+		return false;
+	}
+	void* data = mmap( nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, _file, 0 );
+	if ( data == MAP_FAILED ) {
+		this->close();
+		return false;
+	}
+	_data = (const char*)data;
+	_size = fileStat.st_size;
+#endif
+	return true;
+}
+
+void MappedFile::close() {
+#ifdef _WIN32
+	if ( _data != nullptr ) {
+		UnmapViewOfFile( _data );
+	}
+	if ( _mapping != nullptr ) {
+		CloseHandle( _mapping );
+	}
+	if ( _file != INVALID_HANDLE_VALUE ) {
+		CloseHandle( _file );
+	}
+	_mapping = nullptr;
+	_file = INVALID_HANDLE_VALUE;
+#else
+	if ( _data != nullptr ) {
+		munmap( (void*)_data, _size );
+	}
+	if ( _file >= 0 ) {
+		::close( _file );
+	}
+	_file = -1;
+#endif
+	_data = nullptr;
+	_size = 0;
+}
+
+void MappedFile::adviseSequential() {
+#ifndef _WIN32
+	if ( _data != nullptr ) {
+		madvise( (void*)_data, _size, MADV_SEQUENTIAL );
+	}
+#endif
+}
+
+void MappedFile::adviseWillNeed( uint64_t offset, uint64_t length ) {
+	if ( _data == nullptr || offset >= _size ) {
+		return;
+	}
+	length = std::min( length, _size - offset );
+#ifdef _WIN32
+	WIN32_MEMORY_RANGE_ENTRY range = { (void*)(_data + offset), (SIZE_T)length };
+	PrefetchVirtualMemory( GetCurrentProcess(), 1, &range, 0 );
+#else
+	//madvise wants a page aligned start
+	uint64_t pageSize = sysconf( _SC_PAGESIZE );
+	uint64_t alignedOffset = offset - offset % pageSize;
+	madvise( (void*)(_data + alignedOffset), length + (offset - alignedOffset), MADV_WILLNEED );
+#endif
+}
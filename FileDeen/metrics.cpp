@@ -0,0 +1,178 @@
+#include <atomic>
+#include <cinttypes>
+#include <cstdio>
+#include <fstream>
+#include "cipher.h"
+#include "metrics.h"
+using namespace FileDeen;
+
+namespace {
+	//Each counter gets a cache line of its own so threads bumping different counters don't fight over it
+	struct alignas( 64 ) Counter {
+		std::atomic<uint64_t> value{ 0 };
+
+		void add( uint64_t amount ) {
+			value.fetch_add( amount, std::memory_order_relaxed );
+		}
+		uint64_t load() const {
+			return value.load( std::memory_order_relaxed );
+		}
+	};
+
+	std::atomic<bool> enabled( false );
+	Counter entries, bytes;
+	Counter phaseNanoseconds[phaseCount], phaseCalls[phaseCount];
+	std::chrono::steady_clock::time_point startTime;
+	KeySetupStats keySetupBaseline{ 0, 0 };
+}
+
+const char* FileDeen::phaseName( Phase phase ) {
+	switch ( phase ) {
+		case Phase::Scan:
+			return "scan";
+		case Phase::Read:
+			return "read";
+		case Phase::KeySetup:
+			return "keySetup";
+		case Phase::Cipher:
+			return "cipher";
+		case Phase::Compression:
+			return "compression";
+		case Phase::Write:
+			return "write";
+	}
+	return "unknown";
+}
+
+void FileDeen::setMetricsEnabled( bool enable ) {
+	if ( enable && !enabled.load( std::memory_order_relaxed ) ) {
+		startTime = std::chrono::steady_clock::now();
+		keySetupBaseline = KeyContext::setupStats();
+	}
+	enabled.store( enable, std::memory_order_relaxed );
+}
+
+bool FileDeen::metricsEnabled() {
+	return enabled.load( std::memory_order_relaxed );
+}
+
+void FileDeen::countEntry() {
+	if ( enabled.load( std::memory_order_relaxed ) ) {
+		entries.add( 1 );
+	}
+}
+
+void FileDeen::countBytes( uint64_t length ) {
+	if ( enabled.load( std::memory_order_relaxed ) ) {
+		bytes.add( length );
+	}
+}
+
+
+
+PhaseTimer::PhaseTimer( Phase phase ) : _phase( phase ) {
+	_enabled = enabled.load( std::memory_order_relaxed );
+	if ( _enabled ) {
+		_start = std::chrono::steady_clock::now();
+	}
+}
+
+PhaseTimer::~PhaseTimer() {
+	if ( !_enabled ) {
+		return;
+	}
+	int phase = (int)_phase;
+	phaseNanoseconds[phase].add( std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - _start ).count() );
+	phaseCalls[phase].add( 1 );
+}
+
+
+
+MetricsSnapshot FileDeen::metricsSnapshot() {
+	MetricsSnapshot snapshot;
+	snapshot.seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - startTime ).count();
+	snapshot.entries = entries.load();
+	snapshot.bytes = bytes.load();
+	for ( int i = 0; i < phaseCount; i++ ) {
+		snapshot.phaseNanoseconds[i] = phaseNanoseconds[i].load();
+		snapshot.phaseCalls[i] = phaseCalls[i].load();
+	}
+	KeySetupStats keySetup = KeyContext::setupStats();
+	snapshot.phaseNanoseconds[(int)Phase::KeySetup] += keySetup.nanoseconds - keySetupBaseline.nanoseconds;
+	snapshot.phaseCalls[(int)Phase::KeySetup] += keySetup.count - keySetupBaseline.count;
+	return snapshot;
+}
+
+std::string FileDeen::metricsJson( const MetricsSnapshot& snapshot ) {
+	double seconds = snapshot.seconds > 0 ? snapshot.seconds : 1e-9;
+	char line[256];
+	std::string json = "{\n";
+	snprintf( line, sizeof( line ), "\t\"seconds\": %.6f,\n", snapshot.seconds );
+	json += line;
+	snprintf( line, sizeof( line ), "\t\"entries\": %" PRIu64 ",\n\t\"bytes\": %" PRIu64 ",\n", snapshot.entries, snapshot.bytes );
+	json += line;
+	snprintf( line, sizeof( line ), "\t\"entriesPerSecond\": %.3f,\n\t\"bytesPerSecond\": %.3f,\n", snapshot.entries / seconds, snapshot.bytes / seconds );
+	json += line;
+	json += "\t\"phases\": {\n";
+	for ( int i = 0; i < phaseCount; i++ ) {
+		snprintf( line, sizeof( line ), "\t\t\"%s\": { \"seconds\": %.6f, \"calls\": %" PRIu64 " }%s\n",
+			phaseName( (Phase)i ), snapshot.phaseNanoseconds[i] / 1e9, snapshot.phaseCalls[i], i+1 < phaseCount ? "," : "" );
+		json += line;
+	}
+	json += "\t}\n}\n";
+	return json;
+}
+
+int FileDeen::writeMetrics( std::filesystem::path pathToFile ) {
+	std::ofstream statsFile( pathToFile, std::ios::binary | std::ios::trunc );
+	if ( !statsFile ) {
+		printf( "Error: Could not open \'%s\' for writing\n", pathToFile.u8string().c_str() );
+		return 1;
+	}
+	std::string json = metricsJson( metricsSnapshot() );
+	statsFile.write( json.data(), json.size() );
+	if ( !statsFile ) {
+		printf( "Error: Could not write \'%s\'\n", pathToFile.u8string().c_str() );
+		return 1;
+	}
+	return 0;
+}
+
+
+
+ProgressReporter::ProgressReporter() {
+	_stopping = false;
+}
+
+ProgressReporter::~ProgressReporter() {
+	this->stop();
+}
+
+void ProgressReporter::start( unsigned int intervalSeconds ) {
+	if ( _thread.joinable() || intervalSeconds == 0 ) {
+		return;
+	}
+	_stopping = false;
+	_thread = std::thread( [this, intervalSeconds]() {
+		std::unique_lock<std::mutex> lock( _mutex );
+		while ( !_condition.wait_for( lock, std::chrono::seconds( intervalSeconds ), [this]() { return _stopping; } ) ) {
+			MetricsSnapshot snapshot = metricsSnapshot();
+			double seconds = snapshot.seconds > 0 ? snapshot.seconds : 1e-9;
+			printf( "Progress: %" PRIu64 " entries, %.2fMB in %.1fs (%.2fMB/s, %.1f entries/s)\n", snapshot.entries, snapshot.bytes / 1048576.,
+				snapshot.seconds, snapshot.bytes / 1048576. / seconds, snapshot.entries / seconds );
+			fflush( stdout );
+		}
+	} );
+}
+
+void ProgressReporter::stop() {
+	if ( !_thread.joinable() ) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock( _mutex );
+		_stopping = true;
+	}
+	_condition.notify_all();
+	_thread.join();
+}
@@ -0,0 +1,155 @@
+#include "pathfilter.h"
+using namespace FileDeen;
+
+//Backslashes are taken as folder separators, and separators at either end are dropped so "docs/" means the folder docs
+PathGlob::PathGlob( const std::string& pattern ) : _literal( true ) {
+	_pattern = pattern;
+	for ( auto& c : _pattern ) {
+		if ( c == '\\' ) {
+			c = '/';
+		}
+	}
+	while ( _pattern.size() >= 2 && _pattern[0] == '.' && _pattern[1] == '/' ) {
+		_pattern.erase( 0, 2 );
+	}
+	size_t first = _pattern.find_first_not_of( '/' ), last = _pattern.find_last_not_of( '/' );
+	_pattern = first == std::string::npos ? "" : _pattern.substr( first, last - first + 1 );
+
+	for ( size_t i = 0; i < _pattern.size(); i++ ) {
+		unsigned char c = _pattern[i];
+		Token token;
+		token.kind = Token::Character;
+		if ( c == '*' ) {
+			token.kind = Token::Star;
+			while ( i+1 < _pattern.size() && _pattern[i+1] == '*' ) {
+				token.kind = Token::GlobStar;
+				i++;
+			}
+			_literal = false;
+		}
+		else if ( c == '?' ) {
+			token.characters.set();
+			token.characters.reset( '/' );
+			_literal = false;
+		}
+		else if ( c == '[' ) {
+			//A ']' straight after the opening bracket is part of the set, a bracket that's never closed is just a bracket
+			size_t position = i + 1;
+			bool negate = position < _pattern.size() && (_pattern[position] == '!' || _pattern[position] == '^');
+			if ( negate ) {
+				position++;
+			}
+			size_t end = _pattern.find( ']', position + 1 );
+			if ( end == std::string::npos ) {
+				token.characters.set( c );
+				_tokens.push_back( token );
+				continue;
+			}
+			for ( ; position < end; position++ ) {
+				unsigned char low = _pattern[position], high = low;
+				if ( position+2 < end && _pattern[position+1] == '-' ) {
+					high = _pattern[position+2];
+					position += 2;
+				}
+				for ( unsigned int member = low; member <= high; member++ ) {
+					token.characters.set( member );
+				}
+			}
+			if ( negate ) {
+				token.characters.flip();
+			}
+			token.characters.reset( '/' );
+			i = end;
+			_literal = false;
+		}
+		else {
+			token.characters.set( c );
+		}
+		_tokens.push_back( token );
+	}
+}
+
+//Runs every way the pattern could be lined up with the path at once, one character of the path at a time
+bool PathGlob::matches( const std::string& path ) const {
+	const size_t tokenCount = _tokens.size();
+	std::vector<char> active( tokenCount + 1, 0 ), next( tokenCount + 1, 0 );
+	//Stars may match nothing, and "**/" may also match no folder at all where a folder name would start
+	auto skipEmpty = [&]( std::vector<char>& states, bool folderStart ) {
+		for ( size_t i = 0; i < tokenCount; i++ ) {
+			if ( !states[i] || _tokens[i].kind == Token::Character ) {
+				continue;
+			}
+			states[i+1] = 1;
+			if ( folderStart && _tokens[i].kind == Token::GlobStar && i+1 < tokenCount && _tokens[i+1].kind == Token::Character &&
+				_tokens[i+1].characters.count() == 1 && _tokens[i+1].characters.test( '/' ) ) {
+				states[i+2] = 1;
+			}
+		}
+	};
+	active[0] = 1;
+	skipEmpty( active, true );
+
+	for ( unsigned char c : path ) {
+		//Whatever the pattern matched so far is a folder holding the rest of the path
+		if ( c == '/' && active[tokenCount] ) {
+			return true;
+		}
+		std::fill( next.begin(), next.end(), 0 );
+		bool anyActive = false;
+		for ( size_t i = 0; i < tokenCount; i++ ) {
+			if ( !active[i] ) {
+				continue;
+			}
+			const Token& token = _tokens[i];
+			if ( token.kind == Token::Character ) {
+				if ( token.characters.test( c ) ) {
+					next[i+1] = 1;
+					anyActive = true;
+				}
+			}
+			else if ( token.kind == Token::GlobStar || c != '/' ) {
+				next[i] = 1;
+				anyActive = true;
+			}
+		}
+		if ( !anyActive ) {
+			return false;
+		}
+		skipEmpty( next, c == '/' );
+		active.swap( next );
+	}
+	return active[tokenCount] != 0;
+}
+
+
+
+void PathFilter::include( const std::string& pattern ) {
+	_includes.emplace_back( pattern );
+}
+
+void PathFilter::exclude( const std::string& pattern ) {
+	_excludes.emplace_back( pattern );
+}
+
+bool PathFilter::matches( const std::filesystem::path& path ) const {
+	if ( this->empty() ) {
+		return true;
+	}
+	std::string generic = path.generic_u8string();
+	bool included = _includes.empty();
+	for ( const auto& glob : _includes ) {
+		if ( glob.matches( generic ) ) {
+			included = true;
+			break;
+		}
+	}
+	if ( !included ) {
+		return false;
+	}
+	for ( const auto& glob : _excludes ) {
+		if ( glob.matches( generic ) ) {
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,428 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+#include "asyncfile.h"
+#include "checksum.h"
+#include "cipher.h"
+#include "encoder.h"
+#include "filedeen.h"
+using namespace std;
+namespace fs = filesystem;
+
+//Measures cipher, archive write and archive read throughput
+//Results are printed to stdout as CSV so runs of different versions can be compared, progress goes to stderr
+//Usage: FileDeenBench [scale] [work folder]
+//	scale multiplies the size of every synthetic corpus, default 1
+//Built with FILEDEEN_COUNT_ALLOCATIONS it first checks that encoding and decoding don't allocate once per block, and fails if they do
+
+const double minimumSeconds = 0.5;
+const string benchKey = "FileDeenBench";
+
+mt19937_64 RNG( 0x46654442 );
+
+#ifdef FILEDEEN_COUNT_ALLOCATIONS
+//Every allocation in the process goes through here, array allocations included
+atomic<uint64_t> allocationCount( 0 );
+
+void* operator new( size_t size ) {
+	allocationCount++;
+	void* memory = malloc( size > 0 ? size : 1 );
+	if ( memory == nullptr ) {
+		throw bad_alloc();
+	}
+	return memory;
+}
+
+void operator delete( void* memory ) noexcept {
+	free( memory );
+}
+
+void operator delete( void* memory, size_t size ) noexcept {
+	free( memory );
+}
+#endif
+
+struct BenchResult {
+	uint64_t entries;
+	uint64_t bytes;
+	double seconds;
+};
+
+void printHeader() {
+	printf( "formatVersion,benchmark,case,variant,bufferBytes,entries,bytes,seconds,mbPerSecond,entriesPerSecond\n" );
+}
+
+void printResult( const char* benchmark, const string& benchCase, const string& variant, size_t bufferSize, BenchResult result ) {
+	double seconds = result.seconds > 0 ? result.seconds : 1e-9;
+	printf( "%u,%s,%s,%s,%zu,%llu,%llu,%.6f,%.2f,%.2f\n", FileDeen::formatVersion, benchmark, benchCase.c_str(), variant.c_str(), bufferSize,
+		(unsigned long long)result.entries, (unsigned long long)result.bytes, result.seconds,
+		result.bytes / seconds / (1024.*1024.), result.entries / seconds );
+	fflush( stdout );
+}
+
+double secondsSince( chrono::steady_clock::time_point start ) {
+	return chrono::duration<double>( chrono::steady_clock::now() - start ).count();
+}
+
+FileDeen::InitVector randomInitVector() {
+	FileDeen::InitVector initVector;
+	for ( auto& byte : initVector ) {
+		byte = (char)RNG();
+	}
+	return initVector;
+}
+
+//Cipher throughput for every kernel the CPU supports, one CBCEncrypt call per buffer with the v5 transform and with AES-CTR
+void benchCipher() {
+	const size_t bufferSizes[] = { 64, 4*1024, 64*1024, 1024*1024, 16*1024*1024 };
+	const FileDeen::CipherKernel kernels[] = { FileDeen::CipherKernel::Scalar, FileDeen::CipherKernel::SSE2, FileDeen::CipherKernel::AVX2, FileDeen::CipherKernel::AVX512 };
+	FileDeen::CipherKernel originalKernel = FileDeen::cipherKernel();
+	FileDeen::KeyContext key( benchKey );
+	FileDeen::InitVector initVector = randomInitVector();
+
+	const unsigned char versions[] = { FileDeen::minimumFormatVersion, FileDeen::formatVersion };
+
+	for ( FileDeen::CipherKernel kernel : kernels ) {
+		if ( !FileDeen::setCipherKernel( kernel ) ) {
+			continue;
+		}
+		for ( unsigned char versionByte : versions ) {
+			bool aes = FileDeen::cipherScheme( versionByte ) == FileDeen::CipherScheme::AESCTR;
+			const char* kernelName = aes ? FileDeen::aesKernelName( kernel ) : FileDeen::cipherKernelName( kernel );
+			for ( size_t bufferSize : bufferSizes ) {
+				fprintf( stderr, "cipher: %s %s, %zu bytes\n", aes ? "AES-CTR" : "v5", kernelName, bufferSize );
+				string buffer( bufferSize, 'F' );
+				buffer.reserve( bufferSize+FileDeen::blockSize );
+				BenchResult result = { 0, 0, 0 };
+				auto start = chrono::steady_clock::now();
+				do {
+					for ( int i = 0; i < 16; i++ ) {
+						FileDeen::CBCEncrypt( buffer, key, initVector, versionByte );
+						buffer.resize( bufferSize );
+						result.entries++;
+						result.bytes += bufferSize;
+					}
+					result.seconds = secondsSince( start );
+				} while ( result.seconds < minimumSeconds );
+				printResult( "cipher", aes ? "encrypt-aes" : "encrypt", kernelName, bufferSize, result );
+			}
+		}
+	}
+	FileDeen::setCipherKernel( originalKernel );
+
+	//Key setup is paid once per archive, so it only matters relative to tiny archives
+	fprintf( stderr, "cipher: key setup\n" );
+	BenchResult result = { 0, 0, 0 };
+	auto start = chrono::steady_clock::now();
+	do {
+		FileDeen::KeyContext setupKey( benchKey + to_string( result.entries ) );
+		result.entries++;
+		result.seconds = secondsSince( start );
+	} while ( result.seconds < minimumSeconds );
+	printResult( "cipher", "keysetup", FileDeen::cipherKernelName( originalKernel ), 0, result );
+}
+
+//Checksum throughput, verifying an archive can't run faster than this per thread
+void benchChecksum() {
+	const size_t bufferSize = 1024*1024;
+	fprintf( stderr, "checksum: %zu bytes\n", bufferSize );
+	vector<char> buffer( bufferSize );
+	for ( auto& byte : buffer ) {
+		byte = (char)RNG();
+	}
+	BenchResult result = { 0, 0, 0 };
+	uint32_t checksum = 0;
+	auto start = chrono::steady_clock::now();
+	do {
+		for ( int i = 0; i < 16; i++ ) {
+			checksum = FileDeen::crc32c( checksum, &buffer[0], bufferSize );
+			result.entries++;
+			result.bytes += bufferSize;
+		}
+		result.seconds = secondsSince( start );
+	} while ( result.seconds < minimumSeconds );
+	printResult( "checksum", "crc32c", FileDeen::hardwareChecksum() ? "SSE4.2" : "Software", bufferSize, result );
+}
+
+void writeRandomFile( fs::path filePath, uint64_t length ) {
+	fs::create_directories( filePath.parent_path() );
+	fstream outputFile( filePath, ios::out | ios::binary | ios::trunc );
+	vector<char> buffer( 1024*1024 );
+	while ( length > 0 ) {
+		size_t chunkLength = (size_t)min<uint64_t>( length, buffer.size() );
+		for ( size_t i = 0; i < chunkLength; i += sizeof( uint64_t ) ) {
+			uint64_t value = RNG();
+			memcpy( &buffer[i], &value, min( sizeof( value ), chunkLength-i ) );
+		}
+		outputFile.write( &buffer[0], chunkLength );
+		length -= chunkLength;
+	}
+}
+
+//Synthetic corpora, created once under the work folder and reused by every encode
+uint64_t makeTinyFiles( fs::path folder, int scale ) {
+	uint64_t totalSize = 0;
+	uniform_int_distribution<int> sizeDistribution( 0, 1024 );
+	for ( int i = 0; i < 10000*scale; i++ ) {
+		uint64_t length = sizeDistribution( RNG );
+		writeRandomFile( folder / to_string( i / 1000 ) / (to_string( i ) + ".bin"), length );
+		totalSize += length;
+	}
+	return totalSize;
+}
+
+uint64_t makeHugeFiles( fs::path folder, int scale ) {
+	uint64_t totalSize = 0;
+	for ( int i = 0; i < 4; i++ ) {
+		uint64_t length = 64ull*1024*1024*scale + i*12345;
+		writeRandomFile( folder / (to_string( i ) + ".bin"), length );
+		totalSize += length;
+	}
+	return totalSize;
+}
+
+uint64_t makeDeepTree( fs::path folder, int scale ) {
+	uint64_t totalSize = 0;
+	uniform_int_distribution<int> sizeDistribution( 0, 64*1024 );
+	for ( int branch = 0; branch < 4*scale; branch++ ) {
+		fs::path current = folder / ("b" + to_string( branch ));
+		for ( int depth = 0; depth < 24; depth++ ) {
+			current /= "d" + to_string( depth );
+			for ( int i = 0; i < 4; i++ ) {
+				uint64_t length = sizeDistribution( RNG );
+				writeRandomFile( current / (to_string( i ) + ".bin"), length );
+				totalSize += length;
+			}
+		}
+	}
+	return totalSize;
+}
+
+//Discards decoded data, so decode timings measure the reader rather than the disk
+class NullVisitor : public FileDeen::FeD_EntryVisitor {
+public:
+	void beginEntry( const FileDeen::FeD_Entry& ) override {};
+	void entryData( const FileDeen::FeD_Entry&, const char* data, size_t length ) override { _checksum += (unsigned char)data[length-1]; };
+	void endEntry( const FileDeen::FeD_Entry& ) override {};
+
+private:
+	uint64_t _checksum = 0;
+};
+
+//Writes decoded entries back to disk, as a real decode does
+class FileVisitor : public FileDeen::FeD_EntryVisitor {
+public:
+	FileVisitor( fs::path rootFolder ) : _rootFolder( rootFolder ) {};
+
+	void beginEntry( const FileDeen::FeD_Entry& entry ) override {
+		fs::path outputFileName = _rootFolder / entry.path();
+		fs::create_directories( outputFileName.parent_path() );
+		_outputFile.open( outputFileName );
+	}
+
+	void entryData( const FileDeen::FeD_Entry&, const char* data, size_t length ) override {
+		_outputFile.write( data, length );
+	}
+
+	void endEntry( const FileDeen::FeD_Entry& ) override {
+		_outputFile.close();
+	}
+
+	void finish() { _outputFile.finish(); };
+
+private:
+	fs::path _rootFolder;
+	FileDeen::AsyncFileWriter _outputFile;
+};
+
+//End to end encode and decode of one corpus, at a single thread and at every hardware thread
+void benchCorpus( const string& corpusName, fs::path corpusFolder, uint64_t corpusSize, fs::path workFolder ) {
+	const size_t bufferSize = FileDeen::defaultStreamBufferSize;
+	vector<FileDeen::EncodeJob> jobs;
+	for ( const auto& dirEntry : fs::recursive_directory_iterator( corpusFolder ) ) {
+		if ( dirEntry.is_regular_file() ) {
+			jobs.push_back( { dirEntry.path(), fs::relative( dirEntry.path(), corpusFolder ), dirEntry.file_size() } );
+		}
+	}
+	fs::path archivePath = workFolder / (corpusName + ".fed");
+	FileDeen::KeyContext key( benchKey );
+
+	for ( unsigned int threads : { 1u, 0u } ) {
+		FileDeen::ParallelEncoder encoder( threads, bufferSize );
+		if ( threads == 0 && encoder.threadCount() == 1 ) {
+			continue;
+		}
+		fprintf( stderr, "encode: %s, %u threads\n", corpusName.c_str(), encoder.threadCount() );
+		FileDeen::FeD_Writer writer( bufferSize );
+		auto start = chrono::steady_clock::now();
+		if ( writer.open( archivePath, string( (const char*)FileDeen::SIGN, sizeof( FileDeen::SIGN ) ) ) != 0 ) {
+			return;
+		}
+		encoder.encode( jobs, writer, key, false );
+		writer.close();
+		BenchResult result = { jobs.size(), corpusSize, secondsSince( start ) };
+		printResult( "encode", corpusName, to_string( encoder.threadCount() ) + "threads", bufferSize, result );
+	}
+
+	{
+		fprintf( stderr, "encode: %s, solid\n", corpusName.c_str() );
+		fs::path solidArchivePath = workFolder / (corpusName + "_solid.fed");
+		FileDeen::ParallelEncoder encoder( 0, bufferSize );
+		encoder.setSolidThreshold( 64*1024 );
+		FileDeen::FeD_Writer writer( bufferSize );
+		auto start = chrono::steady_clock::now();
+		if ( writer.open( solidArchivePath, string( (const char*)FileDeen::SIGN, sizeof( FileDeen::SIGN ) ) ) != 0 ) {
+			return;
+		}
+		encoder.encode( jobs, writer, key, false );
+		writer.close();
+		BenchResult result = { jobs.size(), corpusSize, secondsSince( start ) };
+		printResult( "encode", corpusName, to_string( encoder.threadCount() ) + "threads_solid", bufferSize, result );
+
+		fprintf( stderr, "decode: %s, solid, discarding data\n", corpusName.c_str() );
+		FileDeen::FeD fedFile;
+		NullVisitor visitor;
+		start = chrono::steady_clock::now();
+		fedFile.readFromFile( solidArchivePath, key, false, visitor, bufferSize );
+		result = { jobs.size(), corpusSize, secondsSince( start ) };
+		printResult( "decode", corpusName, "memory_solid", bufferSize, result );
+		fs::remove( solidArchivePath );
+	}
+
+	{
+		fprintf( stderr, "decode: %s, discarding data\n", corpusName.c_str() );
+		FileDeen::FeD fedFile;
+		NullVisitor visitor;
+		auto start = chrono::steady_clock::now();
+		fedFile.readFromFile( archivePath, key, false, visitor, bufferSize );
+		BenchResult result = { jobs.size(), corpusSize, secondsSince( start ) };
+		printResult( "decode", corpusName, "memory", bufferSize, result );
+	}
+
+	//Files are written through io_uring where it's available, and through the thread fallback for comparison
+	for ( bool ioRing : { true, false } ) {
+		if ( ioRing && !FileDeen::ioRingAvailable() ) {
+			continue;
+		}
+		FileDeen::setIoRingEnabled( ioRing );
+		fprintf( stderr, "decode: %s, writing files with %s\n", corpusName.c_str(), FileDeen::asyncBackendName() );
+		fs::path outputFolder = workFolder / (corpusName + "_decoded");
+		fs::remove_all( outputFolder );
+		FileDeen::FeD fedFile;
+		auto start = chrono::steady_clock::now();
+		{
+			FileVisitor visitor( outputFolder );
+			fedFile.readFromFile( archivePath, key, false, visitor, bufferSize );
+			visitor.finish();
+		}
+		BenchResult result = { jobs.size(), corpusSize, secondsSince( start ) };
+		printResult( "decode", corpusName, string( "disk_" ) + FileDeen::asyncBackendName(), bufferSize, result );
+		fs::remove_all( outputFolder );
+	}
+	FileDeen::setIoRingEnabled( true );
+	fs::remove( archivePath );
+}
+
+#ifdef FILEDEEN_COUNT_ALLOCATIONS
+//Encodes and decodes the same file with a quarter of the buffer size, which makes for four times as many blocks
+//Allocations made once per entry or per buffer stay the same, so any difference between the two is allocations made per block
+bool checkAllocations( fs::path workFolder ) {
+	const size_t bufferSizes[] = { 1024*1024, 256*1024 };
+	fs::path corpusFolder = workFolder / "allocations";
+	writeRandomFile( corpusFolder / "random.bin", 32*1024*1024 );
+	{
+		//Compressible, to take the compressor and decompressor along
+		fstream file( corpusFolder / "text.txt", ios::out | ios::binary | ios::trunc );
+		string line = "FileDeen stores every entry encrypted, and compresses the ones that look compressible.\n";
+		for ( size_t length = 0; length < 32*1024*1024; length += line.size() ) {
+			file.write( line.data(), line.size() );
+		}
+	}
+	vector<FileDeen::EncodeJob> jobs;
+	for ( const auto& dirEntry : fs::directory_iterator( corpusFolder ) ) {
+		jobs.push_back( { dirEntry.path(), dirEntry.path().filename(), dirEntry.file_size() } );
+	}
+	fs::path archivePath = workFolder / "allocations.fed";
+	FileDeen::KeyContext key( benchKey );
+
+	uint64_t counts[2][2];
+	for ( int i = 0; i < 2; i++ ) {
+		FileDeen::ParallelEncoder encoder( 1, bufferSizes[i] );
+		encoder.setCompression( true );
+		FileDeen::FeD_Writer writer( bufferSizes[i] );
+		uint64_t start = allocationCount;
+		if ( writer.open( archivePath, string( (const char*)FileDeen::SIGN, sizeof( FileDeen::SIGN ) ) ) != 0 ) {
+			return false;
+		}
+		encoder.encode( jobs, writer, key, false );
+		writer.close();
+		counts[i][0] = allocationCount - start;
+
+		FileDeen::FeD fedFile;
+		NullVisitor visitor;
+		start = allocationCount;
+		fedFile.readFromFile( archivePath, key, false, visitor, bufferSizes[i] );
+		counts[i][1] = allocationCount - start;
+	}
+	fs::remove_all( corpusFolder );
+	fs::remove( archivePath );
+
+	//Buffers are pooled as they're first needed, a smaller buffer size can need a few more of them before it settles
+	const uint64_t slack = 16;
+	bool perBlock = false;
+	const char* phases[] = { "encode", "decode" };
+	for ( int phase = 0; phase < 2; phase++ ) {
+		fprintf( stderr, "allocations: %s, %llu with %zu byte buffers, %llu with %zu byte buffers\n", phases[phase],
+			(unsigned long long)counts[0][phase], bufferSizes[0], (unsigned long long)counts[1][phase], bufferSizes[1] );
+		if ( counts[1][phase] > counts[0][phase] + slack ) {
+			fprintf( stderr, "Error: %s allocates once per block\n", phases[phase] );
+			perBlock = true;
+		}
+	}
+	return !perBlock;
+}
+#endif
+
+int main( int argc, char* argv[] ) {
+	int scale = argc > 1 ? max( atoi( argv[1] ), 1 ) : 1;
+	fs::path workFolder = argc > 2 ? fs::path( argv[2] ) : fs::temp_directory_path() / "FileDeenBench";
+
+#ifdef FILEDEEN_COUNT_ALLOCATIONS
+	if ( !checkAllocations( workFolder ) ) {
+		return 1;
+	}
+#endif
+
+	printHeader();
+	benchCipher();
+	benchChecksum();
+
+	fs::remove_all( workFolder );
+	struct Corpus {
+		string name;
+		uint64_t( *make )( fs::path, int );
+	};
+	const Corpus corpora[] = {
+		{ "tinyfiles", makeTinyFiles },
+		{ "hugefiles", makeHugeFiles },
+		{ "deeptree", makeDeepTree }
+	};
+	for ( const auto& corpus : corpora ) {
+		fprintf( stderr, "creating corpus: %s\n", corpus.name.c_str() );
+		fs::path corpusFolder = workFolder / "corpus" / corpus.name;
+		uint64_t corpusSize = corpus.make( corpusFolder, scale );
+		benchCorpus( corpus.name, corpusFolder, corpusSize, workFolder );
+		fs::remove_all( corpusFolder );
+	}
+	fs::remove_all( workFolder );
+	return 0;
+}